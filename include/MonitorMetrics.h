@@ -0,0 +1,128 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <MonitorLayout.h>
+
+// The topics and metrics of the monitor and their slots, shared by the firmware, the layout test, which renders the
+// default table against its reference images, and the fuzz target in test/fuzz.
+
+#define METRIC_MULTIPLIER_IDENTITY      1
+#define METRIC_PATH_DEPTH               4
+
+#define MONITOR_SLOT_0                  { 470, 227, REFRESH_FAST }
+#define MONITOR_SLOT_1                  { 470, 454, REFRESH_FAST }
+#define MONITOR_SLOT_2                  { 470, 681, REFRESH_FAST }
+#define MONITOR_SLOT_3                  { 470, 908, REFRESH_FAST }
+#define MONITOR_SLOT_NONE               { -1, -1 }
+#define MONITOR_PAGE_TOPIC              "monitor/page"
+
+enum MetricType { SPEED, ANGLE, ANGLE_ZERO_CENTERED };
+
+enum PayloadFormat { JSON, MSGPACK };
+
+struct MonitorTopic {
+    char topic[32];
+    PayloadFormat format;
+};
+
+constexpr MonitorTopic monitorTopics[] = {
+    { "boat", JSON }
+};
+
+const int topicsCount = sizeof(monitorTopics)/sizeof(*monitorTopics);
+
+struct MetricPath {
+    const char * segments[METRIC_PATH_DEPTH];
+};
+
+// Metric descriptions are constant and live in flash. The metric type selects the sampling and aggregation
+// functions of the firmware, and the decimals and sign of the digits.
+struct MonitorMetric {
+    const char * topic;
+    MetricPath path;
+    const char * displayName;
+    double multiplier;
+    MetricType type;
+    int decimals;
+    bool sign;
+    MonitorSlot slot;
+    const char * expression;
+    float alarmMin;
+    float alarmMax;
+    bool aggregated;
+};
+
+template <MetricType T> struct MetricTraits;
+template <> struct MetricTraits<SPEED> { enum { decimals = 1, circular = false, fullCircle = false, sign = false, aggregated = false }; };
+template <> struct MetricTraits<ANGLE> { enum { decimals = 0, circular = true, fullCircle = true, sign = false, aggregated = true }; };
+template <> struct MetricTraits<ANGLE_ZERO_CENTERED> { enum { decimals = 0, circular = true, fullCircle = false, sign = true, aggregated = true }; };
+
+// Values outside [alarmMin, alarmMax] raise an alarm: the slot is shown inverted and refreshed immediately.
+// Aggregated metrics show the mean of the samples received within a frame, which smooths noisy angles out, the
+// others the latest sample. By default, angles are aggregated.
+template <MetricType T>
+constexpr MonitorMetric metric(const char * topic, MetricPath path, const char * displayName, MonitorSlot slot, double multiplier = METRIC_MULTIPLIER_IDENTITY, float alarmMin = -INFINITY, float alarmMax = INFINITY, bool aggregated = MetricTraits<T>::aggregated) {
+    return { topic, path, displayName, multiplier, T, MetricTraits<T>::decimals, MetricTraits<T>::sign, slot, nullptr, alarmMin, alarmMax, aggregated };
+}
+
+template <MetricType T>
+constexpr MonitorMetric derivedMetric(MetricPath name, const char * expression, const char * displayName, MonitorSlot slot, double multiplier = METRIC_MULTIPLIER_IDENTITY, float alarmMin = -INFINITY, float alarmMax = INFINITY) {
+    return { "", name, displayName, multiplier, T, MetricTraits<T>::decimals, MetricTraits<T>::sign, slot, expression, alarmMin, alarmMax, false };
+}
+
+constexpr MonitorMetric monitorMetrics[] = {
+    // Derived metrics are computed from the other metrics, referenced by their dotted path, through an RPN
+    // expression evaluated once per frame. Operators: + - * / neg abs sin cos (degrees) hypot atan2 (degrees)
+    // wrap180 wrap360 ema (pops the smoothing factor), e.g. VMG from SOG, COG and a hidden TWD input:
+    // metric<ANGLE>("boat", { "twd" }, "TWD", MONITOR_SLOT_NONE),
+    // derivedMetric<SPEED>({ "vmg" }, "sog cog twd - cos *", "VMG", MONITOR_SLOT_0),
+    metric<SPEED>("boat", { "sog" }, "SOG", MONITOR_SLOT_0),
+    metric<ANGLE_ZERO_CENTERED>("boat", { "drift" }, "DFT", MONITOR_SLOT_1),
+    metric<ANGLE_ZERO_CENTERED>("boat", { "pitch" }, "PTC", MONITOR_SLOT_2),
+    metric<ANGLE_ZERO_CENTERED>("boat", { "roll" }, "RLL", MONITOR_SLOT_3, METRIC_MULTIPLIER_IDENTITY, -25, 25)
+};
+
+const int metricsCount = sizeof(monitorMetrics)/sizeof(*monitorMetrics);
+
+inline bool matchesPath(const MetricPath & path, const char * name) {
+    for (int i = 0; i < METRIC_PATH_DEPTH && path.segments[i]; i++) {
+        size_t len = strlen(path.segments[i]);
+        if (i && *name++ != '.') return false;
+        if (strncmp(name, path.segments[i], len)) return false;
+        name += len;
+    }
+    return !*name;
+}
+
+// Returns the index of the metric with a dotted path, e.g. "imu.euler.x", or -1.
+inline int findMetric(const char * name) {
+    for (int i = 0; i < metricsCount; i++)
+        if (matchesPath(monitorMetrics[i].path, name)) return i;
+    return -1;
+}
+
+inline int findTopic(const char * topic) {
+    for (int i = 0; i < topicsCount; i++)
+        if (!strcmp(topic, monitorTopics[i].topic)) return i;
+    return -1;
+}
+
+inline uint32_t metricsOfTopic(const char * topic) {
+    uint32_t metrics = 0;
+    for (int i = 0; i < metricsCount; i++)
+        if (!strcmp(topic, monitorMetrics[i].topic)) metrics |= 1u << i;
+    return metrics;
+}
+
+// Scales a value received for a metric. Returns whether it can be shown: overflowing numbers of a payload come out
+// as infinities, as do values pushed out of the float range by the multiplier.
+inline bool scaleMetric(const MonitorMetric & metric, float & value) {
+    value *= metric.multiplier;
+    return isfinite(value);
+}
+
+inline bool metricAlarm(const MonitorMetric & metric, float value) {
+    return value < metric.alarmMin || value > metric.alarmMax;
+}
@@ -0,0 +1,338 @@
+#include "Framebuffer.h"
+
+static uint32_t fbPattern(uint8_t color) {
+    return 0x11111111u * (color & 0x0F);
+}
+
+static void fbFillWords(uint32_t * w, size_t words, uint32_t pattern) {
+    for (size_t i = 0; i < words; i++) w[i] = pattern;
+}
+
+static void fbBlitWords(uint32_t * d, const uint32_t * s, const uint32_t * m, size_t words) {
+    for (size_t i = 0; i < words; i++) d[i] = (d[i] & ~m[i]) | (s[i] & m[i]);
+}
+
+static uint32_t fbLaneMask(uint32_t a, uint32_t b) {
+    // a, b hold one pixel per byte: yields 0x0F in every byte where a >= b, 0x00 elsewhere.
+    return ((((a | 0x10101010u) - b) >> 4) & 0x01010101u) * 0x0F;
+}
+
+static uint32_t fbNibbleMinMax(uint32_t a, uint32_t b, bool max) {
+    uint32_t aLo = a & 0x0F0F0F0Fu, bLo = b & 0x0F0F0F0Fu;
+    uint32_t aHi = (a >> 4) & 0x0F0F0F0Fu, bHi = (b >> 4) & 0x0F0F0F0Fu;
+    uint32_t mLo = fbLaneMask(aLo, bLo), mHi = fbLaneMask(aHi, bHi);
+    if (max) return ((aLo & mLo) | (bLo & ~mLo)) | (((aHi & mHi) | (bHi & ~mHi)) << 4);
+    return ((bLo & mLo) | (aLo & ~mLo)) | (((bHi & mHi) | (aHi & ~mHi)) << 4);
+}
+
+static void fbComposeWords(uint32_t * d, const uint32_t * s, size_t words, bool max) {
+    for (size_t i = 0; i < words; i++) d[i] = fbNibbleMinMax(d[i], s[i], max);
+}
+
+// ORs together the XOR of the words of the two buffers: zero when they are equal.
+static uint32_t fbXorWords(const uint32_t * a, const uint32_t * b, size_t words) {
+    uint32_t acc = 0;
+    for (size_t i = 0; i < words; i++) acc |= a[i] ^ b[i];
+    return acc;
+}
+
+static void fbThresholdWords(uint32_t * w, size_t words) {
+    for (size_t i = 0; i < words; i++) w[i] = (w[i] >> 3 & 0x11111111u) * 0xF;
+}
+
+static void fbMarkRow(uint32_t * dirtyRows, int row, bool dirty) {
+    if (dirty) dirtyRows[row / 32] |= 1u << (row % 32);
+    else dirtyRows[row / 32] &= ~(1u << (row % 32));
+}
+
+void fbFillScalar(uint8_t * buf, size_t len, uint8_t color) {
+    fbFillWords((uint32_t *)buf, len / 4, fbPattern(color));
+}
+
+void fbBlitMaskedScalar(uint8_t * dst, const uint8_t * src, const uint8_t * mask, size_t len) {
+    fbBlitWords((uint32_t *)dst, (const uint32_t *)src, (const uint32_t *)mask, len / 4);
+}
+
+void fbComposeScalar(uint8_t * dst, const uint8_t * src, size_t len, bool max) {
+    fbComposeWords((uint32_t *)dst, (const uint32_t *)src, len / 4, max);
+}
+
+bool fbDiffRowScalar(const uint8_t * a, const uint8_t * b, size_t len, int * firstWord, int * lastWord) {
+    const uint32_t * wa = (const uint32_t *)a;
+    const uint32_t * wb = (const uint32_t *)b;
+    int words = len / 4;
+    int first = 0;
+    while (first < words && wa[first] == wb[first]) first++;
+    if (first == words) return false;
+    int last = words - 1;
+    while (wa[last] == wb[last]) last--;
+    *firstWord = first;
+    *lastWord = last;
+    return true;
+}
+
+int fbDiffRowsScalar(const uint8_t * a, const uint8_t * b, int rows, size_t stride, size_t len, uint32_t * dirtyRows) {
+    int dirty = 0;
+    for (int row = 0; row < rows; row++) {
+        bool differs = fbXorWords((const uint32_t *)(a + row * stride), (const uint32_t *)(b + row * stride), len / 4);
+        fbMarkRow(dirtyRows, row, differs);
+        dirty += differs;
+    }
+    return dirty;
+}
+
+void fbThresholdScalar(uint8_t * buf, size_t len) {
+    fbThresholdWords((uint32_t *)buf, len / 4);
+}
+
+#if CONFIG_IDF_TARGET_ESP32S3
+
+// Each asm block is self-contained: no vector register or shift amount is expected to survive between two of them.
+
+// Words before the first 16-byte boundary, at most words.
+static size_t fbHeadWords(const void * p, size_t words) {
+    size_t head = ((16 - ((uintptr_t)p & 15)) & 15) / 4;
+    return head < words ? head : words;
+}
+
+static bool fbSameAlignment(const void * a, const void * b) {
+    return !(((uintptr_t)a ^ (uintptr_t)b) & 15);
+}
+
+void fbFillPie(uint8_t * buf, size_t len, uint8_t color) {
+    uint32_t pattern = fbPattern(color);
+    uint32_t * w = (uint32_t *)buf;
+    size_t words = len / 4;
+    size_t head = fbHeadWords(w, words);
+    fbFillWords(w, head, pattern);
+    w += head;
+    words -= head;
+    for (size_t i = 0; i < words / 4; i++)
+        asm volatile ("ee.vldbc.32 q0, %[pattern]\n"
+                      "ee.vst.128.ip q0, %[w], 16\n"
+                      : [w] "+r" (w) : [pattern] "r" (&pattern) : "memory");
+    fbFillWords(w, words % 4, pattern);
+}
+
+void fbBlitMaskedPie(uint8_t * dst, const uint8_t * src, const uint8_t * mask, size_t len) {
+    uint32_t * d = (uint32_t *)dst;
+    const uint32_t * s = (const uint32_t *)src;
+    const uint32_t * m = (const uint32_t *)mask;
+    size_t words = len / 4;
+    if (!fbSameAlignment(d, s) || !fbSameAlignment(d, m)) return fbBlitWords(d, s, m, words);
+    size_t head = fbHeadWords(d, words);
+    fbBlitWords(d, s, m, head);
+    d += head;
+    s += head;
+    m += head;
+    words -= head;
+    uint32_t * load = d;
+    for (size_t i = 0; i < words / 4; i++)
+        asm volatile ("ee.vld.128.ip q0, %[load], 16\n"
+                      "ee.vld.128.ip q1, %[s], 16\n"
+                      "ee.vld.128.ip q2, %[m], 16\n"
+                      "ee.andq q1, q1, q2\n"
+                      "ee.notq q2, q2\n"
+                      "ee.andq q0, q0, q2\n"
+                      "ee.orq q0, q0, q1\n"
+                      "ee.vst.128.ip q0, %[d], 16\n"
+                      : [d] "+r" (d), [load] "+r" (load), [s] "+r" (s), [m] "+r" (m) :: "memory");
+    fbBlitWords(d, s, m, words % 4);
+}
+
+// Pixels are split into low and high nibbles, one per byte, so that the signed byte min/max applies.
+void fbComposePie(uint8_t * dst, const uint8_t * src, size_t len, bool max) {
+    uint32_t * d = (uint32_t *)dst;
+    const uint32_t * s = (const uint32_t *)src;
+    size_t words = len / 4;
+    if (!fbSameAlignment(d, s)) return fbComposeWords(d, s, words, max);
+    size_t head = fbHeadWords(d, words);
+    fbComposeWords(d, s, head, max);
+    d += head;
+    s += head;
+    words -= head;
+    const uint32_t nibbles = 0x0F0F0F0Fu;
+    uint32_t * load = d;
+    for (size_t i = 0; i < words / 4; i++) {
+        if (max)
+            asm volatile ("ssai 4\n"
+                          "ee.vldbc.32 q7, %[nibbles]\n"
+                          "ee.vld.128.ip q0, %[load], 16\n"
+                          "ee.vld.128.ip q1, %[s], 16\n"
+                          "ee.andq q2, q0, q7\n"
+                          "ee.andq q3, q1, q7\n"
+                          "ee.vmax.s8 q2, q2, q3\n"
+                          "ee.vsr.32 q0, q0\n"
+                          "ee.vsr.32 q1, q1\n"
+                          "ee.andq q0, q0, q7\n"
+                          "ee.andq q1, q1, q7\n"
+                          "ee.vmax.s8 q0, q0, q1\n"
+                          "ee.vsl.32 q0, q0\n"
+                          "ee.orq q0, q0, q2\n"
+                          "ee.vst.128.ip q0, %[d], 16\n"
+                          : [d] "+r" (d), [load] "+r" (load), [s] "+r" (s) : [nibbles] "r" (&nibbles) : "sar", "memory");
+        else
+            asm volatile ("ssai 4\n"
+                          "ee.vldbc.32 q7, %[nibbles]\n"
+                          "ee.vld.128.ip q0, %[load], 16\n"
+                          "ee.vld.128.ip q1, %[s], 16\n"
+                          "ee.andq q2, q0, q7\n"
+                          "ee.andq q3, q1, q7\n"
+                          "ee.vmin.s8 q2, q2, q3\n"
+                          "ee.vsr.32 q0, q0\n"
+                          "ee.vsr.32 q1, q1\n"
+                          "ee.andq q0, q0, q7\n"
+                          "ee.andq q1, q1, q7\n"
+                          "ee.vmin.s8 q0, q0, q1\n"
+                          "ee.vsl.32 q0, q0\n"
+                          "ee.orq q0, q0, q2\n"
+                          "ee.vst.128.ip q0, %[d], 16\n"
+                          : [d] "+r" (d), [load] "+r" (load), [s] "+r" (s) : [nibbles] "r" (&nibbles) : "sar", "memory");
+    }
+    fbComposeWords(d, s, words % 4, max);
+}
+
+// ORs together the four lanes of the XOR of a 16-byte block of each buffer.
+static uint32_t fbXorBlock(const uint32_t * a, const uint32_t * b) {
+    uint32_t x0, x1, x2, x3;
+    asm volatile ("ee.vld.128.ip q0, %[a], 0\n"
+                  "ee.vld.128.ip q1, %[b], 0\n"
+                  "ee.xorq q0, q0, q1\n"
+                  "ee.movi.32.a q0, %[x0], 0\n"
+                  "ee.movi.32.a q0, %[x1], 1\n"
+                  "ee.movi.32.a q0, %[x2], 2\n"
+                  "ee.movi.32.a q0, %[x3], 3\n"
+                  : [x0] "=r" (x0), [x1] "=r" (x1), [x2] "=r" (x2), [x3] "=r" (x3)
+                  : [a] "r" (a), [b] "r" (b) : "memory");
+    return x0 | x1 | x2 | x3;
+}
+
+// The first and last differing blocks are found 16 bytes at a time, then refined word by word.
+bool fbDiffRowPie(const uint8_t * a, const uint8_t * b, size_t len, int * firstWord, int * lastWord) {
+    const uint32_t * wa = (const uint32_t *)a;
+    const uint32_t * wb = (const uint32_t *)b;
+    int words = len / 4;
+    if (!fbSameAlignment(wa, wb)) return fbDiffRowScalar(a, b, len, firstWord, lastWord);
+    int head = fbHeadWords(wa, words);
+    int tail = head + (words - head) / 4 * 4;
+    int first = 0;
+    while (first < head && wa[first] == wb[first]) first++;
+    if (first == head) {
+        while (first < tail && !fbXorBlock(wa + first, wb + first)) first += 4;
+        while (first < words && wa[first] == wb[first]) first++;
+    }
+    if (first == words) return false;
+    int last = words - 1;
+    while (last >= tail && wa[last] == wb[last]) last--;
+    if (last < tail) {
+        while (last >= head && !fbXorBlock(wa + last - 3, wb + last - 3)) last -= 4;
+        while (wa[last] == wb[last]) last--;
+    }
+    *firstWord = first;
+    *lastWord = last;
+    return true;
+}
+
+static bool fbRowDiffers(const uint32_t * a, const uint32_t * b, size_t words) {
+    // Rows aligned differently cannot be loaded in step.
+    if (!fbSameAlignment(a, b)) return fbXorWords(a, b, words);
+    size_t head = fbHeadWords(a, words);
+    if (fbXorWords(a, b, head)) return true;
+    a += head;
+    b += head;
+    words -= head;
+    for (size_t i = 0; i < words / 4; i++, a += 4, b += 4)
+        if (fbXorBlock(a, b)) return true;
+    return fbXorWords(a, b, words % 4);
+}
+
+int fbDiffRowsPie(const uint8_t * a, const uint8_t * b, int rows, size_t stride, size_t len, uint32_t * dirtyRows) {
+    int dirty = 0;
+    for (int row = 0; row < rows; row++) {
+        bool differs = fbRowDiffers((const uint32_t *)(a + row * stride), (const uint32_t *)(b + row * stride), len / 4);
+        fbMarkRow(dirtyRows, row, differs);
+        dirty += differs;
+    }
+    return dirty;
+}
+
+// (w >> 3 & 0x11111111) * 15, with the multiplication as (x << 4) - x: both terms stay below 2^31, so the
+// saturating subtraction never saturates.
+void fbThresholdPie(uint8_t * buf, size_t len) {
+    uint32_t * w = (uint32_t *)buf;
+    size_t words = len / 4;
+    size_t head = fbHeadWords(w, words);
+    fbThresholdWords(w, head);
+    w += head;
+    words -= head;
+    const uint32_t ones = 0x11111111u;
+    uint32_t * load = w;
+    for (size_t i = 0; i < words / 4; i++)
+        asm volatile ("ee.vldbc.32 q7, %[ones]\n"
+                      "ee.vld.128.ip q0, %[load], 16\n"
+                      "ssai 3\n"
+                      "ee.vsr.32 q0, q0\n"
+                      "ee.andq q0, q0, q7\n"
+                      "ssai 4\n"
+                      "ee.vsl.32 q1, q0\n"
+                      "ee.vsubs.s32 q0, q1, q0\n"
+                      "ee.vst.128.ip q0, %[w], 16\n"
+                      : [w] "+r" (w), [load] "+r" (load) : [ones] "r" (&ones) : "sar", "memory");
+    fbThresholdWords(w, words % 4);
+}
+
+#endif
+
+#if FRAMEBUFFER_PIE && CONFIG_IDF_TARGET_ESP32S3
+
+void fbFill(uint8_t * buf, size_t len, uint8_t color) {
+    fbFillPie(buf, len, color);
+}
+
+void fbBlitMasked(uint8_t * dst, const uint8_t * src, const uint8_t * mask, size_t len) {
+    fbBlitMaskedPie(dst, src, mask, len);
+}
+
+void fbCompose(uint8_t * dst, const uint8_t * src, size_t len, bool max) {
+    fbComposePie(dst, src, len, max);
+}
+
+bool fbDiffRow(const uint8_t * a, const uint8_t * b, size_t len, int * firstWord, int * lastWord) {
+    return fbDiffRowPie(a, b, len, firstWord, lastWord);
+}
+
+int fbDiffRows(const uint8_t * a, const uint8_t * b, int rows, size_t stride, size_t len, uint32_t * dirtyRows) {
+    return fbDiffRowsPie(a, b, rows, stride, len, dirtyRows);
+}
+
+void fbThreshold(uint8_t * buf, size_t len) {
+    fbThresholdPie(buf, len);
+}
+
+#else
+
+void fbFill(uint8_t * buf, size_t len, uint8_t color) {
+    fbFillScalar(buf, len, color);
+}
+
+void fbBlitMasked(uint8_t * dst, const uint8_t * src, const uint8_t * mask, size_t len) {
+    fbBlitMaskedScalar(dst, src, mask, len);
+}
+
+void fbCompose(uint8_t * dst, const uint8_t * src, size_t len, bool max) {
+    fbComposeScalar(dst, src, len, max);
+}
+
+bool fbDiffRow(const uint8_t * a, const uint8_t * b, size_t len, int * firstWord, int * lastWord) {
+    return fbDiffRowScalar(a, b, len, firstWord, lastWord);
+}
+
+int fbDiffRows(const uint8_t * a, const uint8_t * b, int rows, size_t stride, size_t len, uint32_t * dirtyRows) {
+    return fbDiffRowsScalar(a, b, rows, stride, len, dirtyRows);
+}
+
+void fbThreshold(uint8_t * buf, size_t len) {
+    fbThresholdScalar(buf, len);
+}
+
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include <sdkconfig.h>
+#endif
+
+// Framebuffer kernels: 4bpp buffers are processed one 32-bit word (8 pixels) at a time, or 16 bytes at a time with
+// the PIE vector instructions of the ESP32-S3. Buffers must be word aligned and their length a multiple of 4 bytes,
+// which holds for framebuffer rows and arena blocks. The vector versions cover the 16-byte aligned part of a
+// buffer, the rest goes through the scalar path.
+//
+// The kernels below run the scalar versions unless FRAMEBUFFER_PIE is set on an ESP32-S3. Set it only once
+// `pio test -e LilyGo_EPD47` passes with the vector versions, which test_framebuffer checks against the scalar ones.
+
+#ifndef FRAMEBUFFER_PIE
+#define FRAMEBUFFER_PIE 0
+#endif
+
+void fbFill(uint8_t * buf, size_t len, uint8_t color);
+
+// Copies the pixels of src selected by mask (0xF nibbles) into dst, leaving the others untouched.
+void fbBlitMasked(uint8_t * dst, const uint8_t * src, const uint8_t * mask, size_t len);
+
+// Keeps the darker (min) or lighter (max) pixel of the two layers in dst.
+void fbCompose(uint8_t * dst, const uint8_t * src, size_t len, bool max);
+
+// Returns whether the two rows differ, storing the first and last differing word indices.
+bool fbDiffRow(const uint8_t * a, const uint8_t * b, size_t len, int * firstWord, int * lastWord);
+
+// Compares the first len bytes of each row, sets one bit per differing row in dirtyRows and returns the number
+// of dirty rows.
+int fbDiffRows(const uint8_t * a, const uint8_t * b, int rows, size_t stride, size_t len, uint32_t * dirtyRows);
+
+// Rounds every pixel to pure black or white, as left on the panel by a DU update: 0x8 and above become white.
+void fbThreshold(uint8_t * buf, size_t len);
+
+// Portable versions of the kernels above.
+void fbFillScalar(uint8_t * buf, size_t len, uint8_t color);
+void fbBlitMaskedScalar(uint8_t * dst, const uint8_t * src, const uint8_t * mask, size_t len);
+void fbComposeScalar(uint8_t * dst, const uint8_t * src, size_t len, bool max);
+bool fbDiffRowScalar(const uint8_t * a, const uint8_t * b, size_t len, int * firstWord, int * lastWord);
+int fbDiffRowsScalar(const uint8_t * a, const uint8_t * b, int rows, size_t stride, size_t len, uint32_t * dirtyRows);
+void fbThresholdScalar(uint8_t * buf, size_t len);
+
+#if CONFIG_IDF_TARGET_ESP32S3
+// Vector versions, built on the ESP32-S3 whatever FRAMEBUFFER_PIE, so that they can be tested.
+void fbFillPie(uint8_t * buf, size_t len, uint8_t color);
+void fbBlitMaskedPie(uint8_t * dst, const uint8_t * src, const uint8_t * mask, size_t len);
+void fbComposePie(uint8_t * dst, const uint8_t * src, size_t len, bool max);
+bool fbDiffRowPie(const uint8_t * a, const uint8_t * b, size_t len, int * firstWord, int * lastWord);
+int fbDiffRowsPie(const uint8_t * a, const uint8_t * b, int rows, size_t stride, size_t len, uint32_t * dirtyRows);
+void fbThresholdPie(uint8_t * buf, size_t len);
+#endif
@@ -0,0 +1,39 @@
+#include "IngestQueue.h"
+#include <math.h>
+#include <string.h>
+
+void ingestPush(IngestSlot & slot, IngestCounters & counters, const char * data, size_t len, bool queued, unsigned long now) {
+    if (queued && slot.pendingLength) counters.dropped++;
+    // The jitter is the mean deviation between consecutive intervals.
+    if (slot.lastArrival) {
+        float interval = now - slot.lastArrival;
+        if (!slot.interval) slot.interval = interval;
+        slot.jitter += (fabsf(interval - slot.interval) - slot.jitter) / INGEST_LINK_SMOOTHING;
+        slot.interval += (interval - slot.interval) / INGEST_LINK_SMOOTHING;
+    }
+    slot.lastArrival = now;
+    if (queued) {
+        memcpy(slot.pending, data, len);
+        slot.pendingLength = len;
+    }
+    counters.received++;
+}
+
+size_t ingestTake(IngestSlot & slot) {
+    size_t len = slot.pendingLength;
+    if (len) {
+        char * parsing = slot.pending;
+        slot.pending = slot.parsing;
+        slot.parsing = parsing;
+        slot.pendingLength = 0;
+    }
+    return len;
+}
+
+bool ingestEventTopic(const char * topic, int topicLength, int dataOffset, int dataLength, int totalLength, char * name, size_t nameSize) {
+    if (dataOffset || dataLength != totalLength || dataLength > INGEST_BUFFER_SIZE) return false;
+    if (topicLength < 0 || (size_t)topicLength >= nameSize) return false;
+    memcpy(name, topic, topicLength);
+    name[topicLength] = 0;
+    return true;
+}
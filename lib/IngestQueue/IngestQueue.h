@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+
+#ifndef INGEST_BUFFER_SIZE
+#define INGEST_BUFFER_SIZE              4096
+#endif
+
+#define INGEST_LINK_SMOOTHING           16
+
+// Latest payload received on a topic: pending is filled on arrival and parsing is read once per frame, the two
+// buffers being swapped when the frame takes the payload. A payload still pending when the next one arrives is
+// replaced and counted as dropped, since only the newest values would be shown anyway. The queue does no locking:
+// callers serialize ingestPush() and ingestTake(), then parse the taken payload outside of their lock, as
+// ingestPush() only ever writes the pending buffer.
+struct IngestSlot {
+    char * pending;
+    char * parsing;
+    size_t pendingLength;
+    unsigned long lastArrival;
+    float interval;
+    float jitter;
+};
+
+struct IngestCounters {
+    unsigned long received;
+    unsigned long dropped;
+};
+
+// Records a payload arrived at now, in milliseconds, in the smoothed inter-arrival time and jitter of the slot,
+// and copies it into the pending buffer if queued. Payloads whose metrics are all parsed on arrival are counted
+// but not queued.
+void ingestPush(IngestSlot & slot, IngestCounters & counters, const char * data, size_t len, bool queued, unsigned long now);
+
+// Swaps the buffers and returns the length of the payload now in the parsing buffer, or 0 if none arrived since
+// the previous take.
+size_t ingestTake(IngestSlot & slot);
+
+// Checks an MQTT data event and copies its topic, topicLength bytes, null-terminated into name, of size nameSize.
+// Returns false for events to ignore: payloads split across several events or longer than INGEST_BUFFER_SIZE are
+// larger than any message the monitor expects, and a topic that does not fit in name is none of its topics.
+bool ingestEventTopic(const char * topic, int topicLength, int dataOffset, int dataLength, int totalLength, char * name, size_t nameSize);
@@ -0,0 +1,112 @@
+#include "JsonStream.h"
+
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+bool jsonSkipSpace(JsonReader & r) {
+    while (r.p < r.end && (*r.p == ' ' || *r.p == '\t' || *r.p == '\n' || *r.p == '\r')) r.p++;
+    return r.p < r.end;
+}
+
+bool jsonSkipString(JsonReader & r) {
+    for (r.p++; r.p < r.end; r.p++) {
+        if (*r.p == '\\') {
+            if (++r.p == r.end) return false;
+        } else if (*r.p == '"') {
+            r.p++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool jsonSkipValue(JsonReader & r) {
+    int depth = 0;
+    do {
+        if (!jsonSkipSpace(r)) return false;
+        char c = *r.p;
+        if (c == '"') {
+            if (!jsonSkipString(r)) return false;
+        } else if (c == '{' || c == '[') {
+            depth++;
+            r.p++;
+        } else if (c == '}' || c == ']' || c == ',' || c == ':') {
+            if (!depth) return false;
+            if (c == '}' || c == ']') depth--;
+            r.p++;
+        } else {
+            // Numbers and literals. Any other byte, a NUL included, is a syntax error.
+            const char * start = r.p;
+            while (r.p < r.end && (isalnum((unsigned char)*r.p) || *r.p == '-' || *r.p == '+' || *r.p == '.')) r.p++;
+            if (r.p == start) return false;
+        }
+    } while (depth);
+    return true;
+}
+
+bool jsonParseNumber(JsonReader & r, float * value) {
+    const char * p = r.p;
+    bool negative = *p == '-';
+    double mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+    if (negative) p++;
+    for (; p < r.end && isdigit((unsigned char)*p); p++, digits = true) mantissa = mantissa * 10 + (*p - '0');
+    if (p < r.end && *p == '.')
+        for (p++; p < r.end && isdigit((unsigned char)*p); p++, digits = true, exponent--) mantissa = mantissa * 10 + (*p - '0');
+    if (!digits) return false;
+    if (p < r.end && (*p == 'e' || *p == 'E')) {
+        int e = 0;
+        bool negativeExponent = ++p < r.end && *p == '-';
+        if (p < r.end && (*p == '-' || *p == '+')) p++;
+        for (; p < r.end && isdigit((unsigned char)*p); p++) e = e < 1000 ? e * 10 + (*p - '0') : 1000;
+        exponent += negativeExponent ? -e : e;
+    }
+    double number = (negative ? -mantissa : mantissa) * pow(10, exponent);
+    *value = fabs(number) <= FLT_MAX ? number : NAN;
+    r.p = p;
+    return true;
+}
+
+bool jsonStreamObject(JsonReader & r, const JsonStreamPaths & paths, uint32_t candidates, int depth) {
+    r.p++;
+    if (!jsonSkipSpace(r)) return false;
+    if (*r.p == '}') {
+        r.p++;
+        return true;
+    }
+    while (true) {
+        if (!jsonSkipSpace(r) || *r.p != '"') return false;
+        const char * key = r.p + 1;
+        if (!jsonSkipString(r)) return false;
+        size_t keyLength = r.p - 1 - key;
+        if (!jsonSkipSpace(r) || *r.p++ != ':' || !jsonSkipSpace(r)) return false;
+        uint32_t matches = 0;
+        for (int i = 0; i < paths.count && depth < paths.depth; i++) {
+            const char * segment = candidates >> i & 1 ? paths.segment(i, depth) : nullptr;
+            if (segment && strlen(segment) == keyLength && !memcmp(segment, key, keyLength)) matches |= 1u << i;
+        }
+        float value;
+        if (matches && *r.p == '{') {
+            if (!jsonStreamObject(r, paths, matches, depth + 1)) return false;
+        } else if (matches && jsonParseNumber(r, &value)) {
+            for (int i = 0; i < paths.count; i++)
+                if (matches >> i & 1 && (depth + 1 == paths.depth || !paths.segment(i, depth + 1))) paths.store(i, value);
+        } else if (!jsonSkipValue(r)) {
+            return false;
+        }
+        if (!jsonSkipSpace(r)) return false;
+        if (*r.p == '}') {
+            r.p++;
+            return true;
+        }
+        if (*r.p++ != ',') return false;
+    }
+}
+
+bool jsonStream(const char * data, size_t len, const JsonStreamPaths & paths, uint32_t candidates) {
+    JsonReader r = { data, data + len };
+    return candidates && jsonSkipSpace(r) && *r.p == '{' && jsonStreamObject(r, paths, candidates, 0);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pull parser over a raw JSON payload, which is not null-terminated. Paths are matched while scanning, so values
+// are stored in one pass without building a document or copying strings. Keys are compared byte by byte, escapes
+// included, and only numbers are taken as values.
+struct JsonReader {
+    const char * p;
+    const char * end;
+};
+
+// The paths to look for, up to 32. segment() returns the segment of a path at a given depth, or null past its last
+// segment, and store() receives the number found at the end of a path.
+struct JsonStreamPaths {
+    int count;
+    int depth;
+    const char * (*segment)(int path, int depth);
+    void (*store)(int path, float value);
+};
+
+bool jsonSkipSpace(JsonReader & r);
+
+// Skips the string starting at the opening quote.
+bool jsonSkipString(JsonReader & r);
+
+// Skips a whole value, nested objects and arrays included.
+bool jsonSkipValue(JsonReader & r);
+
+// Numbers beyond the float range are read as NaN.
+bool jsonParseNumber(JsonReader & r, float * value);
+
+// Reads the object starting at the opening brace. candidates holds the paths whose first depth segments match the
+// keys leading to this object: only their next segment is compared, and only matching objects are descended into,
+// which bounds the recursion to the depth of the paths.
+bool jsonStreamObject(JsonReader & r, const JsonStreamPaths & paths, uint32_t candidates, int depth);
+
+// Streams the candidate paths of the object in data. Values found before a syntax error are kept. Returns whether
+// the whole object was read.
+bool jsonStream(const char * data, size_t len, const JsonStreamPaths & paths, uint32_t candidates);
@@ -0,0 +1,89 @@
+#include "MetricProgram.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const float degToRad = M_PI / 180;
+static const float radToDeg = 180 / M_PI;
+
+struct MetricOperator {
+    const char * token;
+    MetricOp op;
+    int operands;
+};
+
+static const MetricOperator metricOperators[] = {
+    { "+", OP_ADD, 2 }, { "-", OP_SUB, 2 }, { "*", OP_MUL, 2 }, { "/", OP_DIV, 2 },
+    { "neg", OP_NEG, 1 }, { "abs", OP_ABS, 1 }, { "sin", OP_SIN, 1 }, { "cos", OP_COS, 1 },
+    { "hypot", OP_HYPOT, 2 }, { "atan2", OP_ATAN2, 2 }, { "wrap180", OP_WRAP180, 1 }, { "wrap360", OP_WRAP360, 1 },
+    { "ema", OP_EMA, 2 }
+};
+
+bool compileMetricProgram(const char * expression, int (*findMetric)(const char * name), MetricInstruction * program, int capacity, int * length) {
+    char tokens[strlen(expression)+1];
+    char * savePtr;
+    int depth = 0;
+    int count = 0;
+    strcpy(tokens, expression);
+    for (char * token = strtok_r(tokens, " ", &savePtr); token; token = strtok_r(NULL, " ", &savePtr)) {
+        if (count == capacity) return false;
+        MetricInstruction & instruction = program[count++];
+        instruction = { OP_CONST, 0, 0, -1, NAN };
+        char * end;
+        instruction.operand = strtof(token, &end);
+        if (*end) {
+            instruction.op = OP_METRIC;
+            instruction.metric = findMetric(token);
+            for (auto & op : metricOperators) {
+                if (!strcmp(token, op.token)) {
+                    instruction.op = op.op;
+                    instruction.operands = op.operands;
+                }
+            }
+            if (instruction.op == OP_METRIC && instruction.metric < 0) return false;
+        }
+        if (depth < instruction.operands) return false;
+        depth += 1 - instruction.operands;
+        if (depth > METRIC_STACK_SIZE) return false;
+    }
+    *length = count;
+    return depth == 1;
+}
+
+float runMetricProgram(MetricInstruction * program, int length, float (*input)(int metric)) {
+    // Inputs are checked before anything runs, so that an ema before a missing input keeps its state too.
+    for (int i = 0; i < length; i++)
+        if (program[i].op == OP_METRIC && isnan(input(program[i].metric))) return NAN;
+    float stack[METRIC_STACK_SIZE];
+    int sp = 0;
+    for (int i = 0; i < length; i++) {
+        MetricInstruction & instruction = program[i];
+        float a = sp > 1 ? stack[sp - 2] : 0;
+        float b = sp > 0 ? stack[sp - 1] : 0;
+        float result = 0;
+        switch (instruction.op) {
+            case OP_CONST: stack[sp++] = instruction.operand; continue;
+            case OP_METRIC: stack[sp++] = input(instruction.metric); continue;
+            case OP_ADD: result = a + b; break;
+            case OP_SUB: result = a - b; break;
+            case OP_MUL: result = a * b; break;
+            case OP_DIV: result = a / b; break;
+            case OP_NEG: result = -b; break;
+            case OP_ABS: result = fabsf(b); break;
+            case OP_SIN: result = sinf(b * degToRad); break;
+            case OP_COS: result = cosf(b * degToRad); break;
+            case OP_HYPOT: result = hypotf(a, b); break;
+            case OP_ATAN2: result = atan2f(a, b) * radToDeg; break;
+            case OP_WRAP180: result = b - 360 * floorf((b + 180) / 360); break;
+            case OP_WRAP360: result = b - 360 * floorf(b / 360); break;
+            case OP_EMA:
+                instruction.state = isnan(instruction.state) ? a : instruction.state + b * (a - instruction.state);
+                result = instruction.state;
+                break;
+        }
+        sp -= instruction.operands;
+        stack[sp++] = result;
+    }
+    return stack[0];
+}
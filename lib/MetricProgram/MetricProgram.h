@@ -0,0 +1,29 @@
+#pragma once
+
+// Derived metrics are computed from the other metrics through RPN expressions, compiled once into a flat
+// instruction array. Operators: + - * / neg abs sin cos (degrees) hypot atan2 (degrees) wrap180 wrap360 ema (pops
+// the smoothing factor). Any other token is a number or the name of a metric.
+
+#ifndef METRIC_STACK_SIZE
+#define METRIC_STACK_SIZE 8
+#endif
+
+enum MetricOp { OP_CONST, OP_METRIC, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG, OP_ABS, OP_SIN, OP_COS, OP_HYPOT, OP_ATAN2, OP_WRAP180, OP_WRAP360, OP_EMA };
+
+struct MetricInstruction {
+    MetricOp op;
+    int operands;
+    float operand;
+    int metric;
+    float state;
+};
+
+// Compiles expression into at most capacity instructions and stores their count in length. Metric names are
+// resolved with findMetric, which returns -1 for unknown names. The stack depth is checked, so that evaluation
+// needs no checks. Returns whether the expression is valid.
+bool compileMetricProgram(const char * expression, int (*findMetric)(const char * name), MetricInstruction * program, int capacity, int * length);
+
+// Evaluates a compiled program, reading metric values with input(). An input without a value reads as NaN: the
+// program then yields NaN and leaves the state of its ema operators untouched, so that they are seeded by the
+// first real value rather than by a placeholder.
+float runMetricProgram(MetricInstruction * program, int length, float (*input)(int metric));
@@ -0,0 +1,281 @@
+#include "MonitorLayout.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <Framebuffer.h>
+#include "fonts/DSEG14Classic_Regular_100.h"
+#include "fonts/Roboto_Bold_40.h"
+#include "images/SignsMinus.h"
+#include "images/SignsPlus.h"
+
+// Dashes shown in place of the digits of stale metrics, one per DSEG14 digit cell (170 px advance, segment
+// spanning 130 px after a 20 px bearing), centered on the middle segment of the digits.
+static const int dashWidth = 170 * MONITOR_DASH_DIGITS;
+static const int dashHeight = 18;
+alignas(16) static uint8_t dashImage[dashWidth / 2 * dashHeight];
+
+// Large page: two rows of two DSEG14 digits scaled by MONITOR_LARGE_SCALE, spanning the whole screen height.
+static const int largeCellWidth = 130 * MONITOR_LARGE_SCALE;
+static const int largeCellHeight = 208 * MONITOR_LARGE_SCALE;
+static const int largeGap = 540 - 2 * largeCellWidth;
+static const int largeRowY[] = { (960 - 2 * largeCellHeight) / 3, 960 - (960 - 2 * largeCellHeight) / 3 - largeCellHeight };
+static uint8_t * largeDigits[10];
+
+// Alarms on the large pages: a black banner in the gap between the two digit rows, holding the names of the
+// alarmed metrics in white at half the size of the slot labels.
+static const int bannerY = largeRowY[0] + largeCellHeight;
+static const int bannerHeight = largeRowY[1] - bannerY;
+static const int bannerLabelHeight = 32;
+static const int bannerSpacing = 16;
+
+static EpdFont fastDigitsFont;
+
+static uint8_t portraitPixel(const uint8_t * buf, int x, int y) {
+    int panelX = EPD_WIDTH - 1 - y;
+    uint8_t byte = buf[x * EPD_WIDTH / 2 + panelX / 2];
+    return panelX % 2 ? byte >> 4 : byte & 0x0F;
+}
+
+static void beginDashImage() {
+    fbFill(dashImage, sizeof(dashImage), 0xF);
+    for (int y = 0; y < dashHeight; y++)
+        for (int i = 0; i < MONITOR_DASH_DIGITS; i++)
+            memset(dashImage + y * dashWidth / 2 + (i * 170 + 20) / 2, 0x00, 130 / 2);
+}
+
+// Builds the large page digit atlas from the DSEG14 glyphs: each digit is rasterized, then cropped to its 130x208
+// glyph cell and scaled into an image.
+static void beginLargeDigits(uint8_t * scratch, LayoutAlloc alloc) {
+    EpdFontProperties props = epd_font_properties_default();
+    for (int d = 0; d < 10; d++) {
+        char digit[] = { (char)('0' + d), 0 };
+        int cursorX = 0;
+        int cursorY = 208;
+        fbFill(scratch, MONITOR_FB_SIZE, 0xF);
+        epd_write_string(&DSEG14Classic_Regular_100, digit, &cursorX, &cursorY, scratch, &props);
+        largeDigits[d] = (uint8_t *)alloc(largeCellWidth / 2 * largeCellHeight, false);
+        for (int y = 0; y < largeCellHeight; y++) {
+            for (int x = 0; x < largeCellWidth; x += 2) {
+                uint8_t left = portraitPixel(scratch, 20 + x / MONITOR_LARGE_SCALE, y / MONITOR_LARGE_SCALE);
+                uint8_t right = portraitPixel(scratch, 20 + (x + 1) / MONITOR_LARGE_SCALE, y / MONITOR_LARGE_SCALE);
+                largeDigits[d][y * largeCellWidth / 2 + x / 2] = left | right << 4;
+            }
+        }
+    }
+}
+
+// Builds an uncompressed copy of the DSEG14 font for REFRESH_FAST slots, with glyphs thresholded to pure black
+// and white so that DU leaves no half-driven edges. Skipping the zlib decompression also makes these slots faster
+// to draw.
+static void beginFastDigitsFont(uint8_t * scratch, LayoutAlloc alloc) {
+    const EpdFont & font = DSEG14Classic_Regular_100;
+    const int originX = 100;
+    const int originY = 300;
+    EpdFontProperties props = epd_font_properties_default();
+    int glyphsCount = 0;
+    size_t bitmapSize = 0;
+    for (uint32_t i = 0; i < font.interval_count; i++)
+        glyphsCount += font.intervals[i].last - font.intervals[i].first + 1;
+    EpdGlyph * glyphs = (EpdGlyph *)alloc(glyphsCount * sizeof(EpdGlyph), true);
+    memcpy(glyphs, font.glyph, glyphsCount * sizeof(EpdGlyph));
+    for (int g = 0; g < glyphsCount; g++) {
+        glyphs[g].data_offset = bitmapSize;
+        bitmapSize += (glyphs[g].width / 2 + glyphs[g].width % 2) * glyphs[g].height;
+    }
+    uint8_t * bitmap = (uint8_t *)alloc(bitmapSize, false);
+    for (uint32_t i = 0; i < font.interval_count; i++) {
+        const EpdUnicodeInterval & interval = font.intervals[i];
+        for (uint32_t cp = interval.first; cp <= interval.last; cp++) {
+            const EpdGlyph & glyph = glyphs[interval.offset + cp - interval.first];
+            char text[] = { (char)cp, 0 };
+            int cursorX = originX;
+            int cursorY = originY;
+            int byteWidth = glyph.width / 2 + glyph.width % 2;
+            fbFill(scratch, MONITOR_FB_SIZE, 0xF);
+            epd_write_string(&font, text, &cursorX, &cursorY, scratch, &props);
+            // Font bitmaps hold coverage (0xF is ink), the framebuffer holds color (0x0 is black).
+            for (int y = 0; y < glyph.height; y++) {
+                for (int x = 0; x < glyph.width; x++) {
+                    uint8_t ink = portraitPixel(scratch, originX + glyph.left + x, originY - glyph.top + y) < 8 ? 0xF : 0x0;
+                    bitmap[glyph.data_offset + y * byteWidth + x / 2] |= x % 2 ? ink << 4 : ink;
+                }
+            }
+        }
+    }
+    fastDigitsFont = font;
+    fastDigitsFont.bitmap = bitmap;
+    fastDigitsFont.glyph = glyphs;
+    fastDigitsFont.compressed = false;
+}
+
+void beginLayout(uint8_t * scratch, LayoutAlloc alloc) {
+    beginDashImage();
+    beginLargeDigits(scratch, alloc);
+    beginFastDigitsFont(scratch, alloc);
+}
+
+LayoutImage buildBannerLabel(const char * name, uint8_t * scratch, LayoutAlloc alloc) {
+    const int originX = 0;
+    const int originY = 2 * bannerLabelHeight;
+    EpdFontProperties props = epd_font_properties_default();
+    char text[4] = {};
+    strncpy(text, name, 3);
+    int width = 0;
+    for (const char * c = text; *c; c++) {
+        const EpdGlyph * glyph = epd_get_glyph(&Roboto_Bold_40, *c);
+        if (glyph) width += glyph->advance_x;
+    }
+    width = width / 2 + width / 2 % 2;
+    int cursorX = originX;
+    int cursorY = originY - 2;
+    fbFill(scratch, MONITOR_FB_SIZE, 0xF);
+    epd_write_string(&Roboto_Bold_40, text, &cursorX, &cursorY, scratch, &props);
+    uint8_t * label = (uint8_t *)alloc(width / 2 * bannerLabelHeight, false);
+    for (int y = 0; y < bannerLabelHeight; y++) {
+        for (int x = 0; x < width; x++) {
+            int sum = 0;
+            for (int i = 0; i < 4; i++) sum += portraitPixel(scratch, originX + 2 * x + i % 2, 2 * y + i / 2);
+            label[y * width / 2 + x / 2] |= (15 - sum / 4) << (x % 2 * 4);
+        }
+    }
+    return { label, width, bannerLabelHeight };
+}
+
+SlotColumns slotColumns(const MonitorSlot & slot) {
+    int first = EPD_WIDTH - slot.cursorY;
+    int last = first + MONITOR_SLOT_HEIGHT - 1;
+    return { first, last < EPD_WIDTH - 1 ? last : EPD_WIDTH - 1 };
+}
+
+void drawSlotValue(uint8_t * fb, const MonitorSlot & slot, float value, int decimals, bool sign, EpdFontProperties & props) {
+    char digits[16];
+    int cursorX;
+    int cursorY;
+
+    // DSEG14 has no minus glyph: negative values get the sign image even when the metric has no sign, e.g. a
+    // derived VMG.
+    cursorX = 15;
+    cursorY = slot.cursorY - 153;
+    if (sign && value >= 0) epd_draw_rotated_image({cursorX, cursorY, SignsPlus_width, SignsPlus_height}, SignsPlus_data, fb);
+    else if (value < 0) epd_draw_rotated_image({cursorX, cursorY, SignsMinus_width, SignsMinus_height}, SignsMinus_data, fb);
+    value = fabsf(value);
+
+    // Out of range values are pinned to the largest one the slot can show, which also bounds the digits buffer.
+    // Decimals take the place of integer digits, e.g. 99.9 for a speed.
+    float displayMax = METRIC_DISPLAY_MAX;
+    for (int i = 0; i < decimals; i++) displayMax /= 10;
+    value = fminf(value, displayMax);
+    snprintf(digits, sizeof(digits), "%.*f", decimals, value);
+    props.flags = EPD_DRAW_ALIGN_RIGHT;
+    cursorX = slot.cursorX;
+    cursorY = slot.cursorY;
+    epd_write_string(slot.refresh == REFRESH_FAST ? &fastDigitsFont : &DSEG14Classic_Regular_100, digits, &cursorX, &cursorY, fb, &props);
+}
+
+void drawSlotDashes(uint8_t * fb, const MonitorSlot & slot) {
+    epd_draw_rotated_image({slot.cursorX - dashWidth, slot.cursorY - 104 - dashHeight / 2, dashWidth, dashHeight}, dashImage, fb);
+}
+
+void drawSlotLabel(uint8_t * fb, const MonitorSlot & slot, const char * name, EpdFontProperties & props) {
+    char stacked[8];
+    int length = 0;
+    for (const char * c = name; *c && c < name + 3; c++) {
+        if (length) stacked[length++] = '\n';
+        stacked[length++] = *c;
+    }
+    stacked[length] = 0;
+    props.flags = EPD_DRAW_ALIGN_CENTER;
+    int cursorX = slot.cursorX + 33;
+    int cursorY = slot.cursorY - 140;
+    epd_write_string(&Roboto_Bold_40, stacked, &cursorX, &cursorY, fb, &props);
+}
+
+// Inverts the band of framebuffer columns holding a slot. The first and last column are left out so that the
+// byte shared with a neighbouring slot, possibly drawn by the other core, is never written.
+void invertSlot(uint8_t * fb, const MonitorSlot & slot) {
+    SlotColumns columns = slotColumns(slot);
+    int first = columns.first + 1;
+    int last = columns.last - 1;
+    for (int row = 0; row < EPD_HEIGHT; row++) {
+        uint8_t * line = fb + row * EPD_WIDTH / 2;
+        int x = first;
+        if (x % 2) line[x++ / 2] ^= 0xF0;
+        for (; x + 1 <= last; x += 2) line[x / 2] ^= 0xFF;
+        if (x == last) line[x / 2] ^= 0x0F;
+    }
+}
+
+void drawSlot(uint8_t * fb, const MonitorSlot & slot, const char * name, int decimals, bool sign, const SlotFrame & frame, EpdFontProperties & props) {
+    if (frame.restored) {
+        EpdFontProperties staleProps = props;
+        staleProps.fg_color = MONITOR_STALE_COLOR;
+        drawSlotValue(fb, slot, frame.value, decimals, sign, staleProps);
+    } else if (frame.stale || !isfinite(frame.value)) {
+        drawSlotDashes(fb, slot);
+    } else {
+        drawSlotValue(fb, slot, frame.value, decimals, sign, props);
+    }
+    drawSlotLabel(fb, slot, name, props);
+    if (frame.alarm) invertSlot(fb, slot);
+}
+
+// The last two digits go on the bottom row, the others on the top one. As in DSEG14, a decimal point takes no
+// cell and is drawn in the gap after its digit.
+void drawLargeDigits(uint8_t * fb, const char * digits) {
+    int cells[4];
+    bool dots[4] = {};
+    int count = 0;
+    for (const char * c = digits; *c; c++) {
+        if (*c == '.' && count) dots[count - 1] = true;
+        if (*c < '0' || *c > '9') continue;
+        if (count == 4) {
+            memmove(cells, cells + 1, sizeof(cells) - sizeof(*cells));
+            memmove(dots, dots + 1, sizeof(dots) - sizeof(*dots));
+            dots[--count] = false;
+        }
+        cells[count++] = *c - '0';
+    }
+    for (int i = 0; i < count; i++) {
+        int fromRight = count - 1 - i;
+        int x = (1 - fromRight % 2) * (largeCellWidth + largeGap);
+        int y = largeRowY[1 - fromRight / 2];
+        epd_draw_rotated_image({x, y, largeCellWidth, largeCellHeight}, largeDigits[cells[i]], fb);
+        if (dots[i]) epd_fill_rect({x + largeCellWidth, y + largeCellHeight - largeGap, largeGap, largeGap}, 0x00, fb);
+    }
+}
+
+void drawCountdown(uint8_t * fb, int64_t remainingMs) {
+    // Seconds are rounded up, so that 000 is shown only once the countdown is over. remainingMs spans centuries for
+    // a far start time, hence the 64-bit arithmetic up to the clamp.
+    int64_t seconds = remainingMs > 0 ? remainingMs / 1000 + (remainingMs % 1000 > 0) : 0;
+    if (seconds > 99 * 60 + 59) seconds = 99 * 60 + 59;
+    char digits[8];
+    snprintf(digits, sizeof(digits), "%d%02d", (int)(seconds / 60), (int)(seconds % 60));
+    drawLargeDigits(fb, digits);
+}
+
+void drawLargeValue(uint8_t * fb, float value, int decimals) {
+    char digits[16];
+    if (value < 0) epd_draw_rotated_image({15, largeRowY[0], SignsMinus_width, SignsMinus_height}, SignsMinus_data, fb);
+    value = fminf(fabsf(value), METRIC_DISPLAY_MAX);
+    snprintf(digits, sizeof(digits), "%.*f", value < 10 ? decimals : 0, value);
+    drawLargeDigits(fb, digits);
+}
+
+void drawLargeDashes(uint8_t * fb) {
+    for (int i = 0; i < 2; i++)
+        epd_fill_rect({i * (largeCellWidth + largeGap) + largeCellWidth / 8, largeRowY[1] + largeCellHeight / 2 - largeGap, largeCellWidth * 3 / 4, 2 * largeGap}, 0x00, fb);
+}
+
+void drawAlarmBanner(uint8_t * fb, const LayoutImage * labels, int count) {
+    if (!count) return;
+    int width = -bannerSpacing;
+    for (int i = 0; i < count; i++) width += labels[i].width + bannerSpacing;
+    epd_fill_rect({0, bannerY, 540, bannerHeight}, 0x00, fb);
+    int x = width < 540 ? (540 - width) / 2 : 0;
+    for (int i = 0; i < count && x + labels[i].width <= 540; i++) {
+        epd_draw_rotated_image({x, bannerY + (bannerHeight - labels[i].height) / 2, labels[i].width, labels[i].height}, labels[i].data, fb);
+        x += labels[i].width + bannerSpacing;
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <epd_driver.h>
+
+// Drawing primitives of the monitor pages, into a 4bpp framebuffer drawn in the portrait orientation. Every offset
+// of the layout lives here, so that the pages can be rendered on the host and checked against reference images
+// (see test/test_layout). Deciding which page and values to draw is left to the firmware.
+
+#ifndef MONITOR_DASH_DIGITS
+#define MONITOR_DASH_DIGITS             2
+#endif
+#ifndef MONITOR_LARGE_SCALE
+#define MONITOR_LARGE_SCALE             2
+#endif
+#ifndef MONITOR_STALE_COLOR
+#define MONITOR_STALE_COLOR             0x8
+#endif
+#ifndef METRIC_DISPLAY_MAX
+#define METRIC_DISPLAY_MAX              999
+#endif
+
+#define MONITOR_FB_SIZE                 (EPD_WIDTH / 2 * EPD_HEIGHT)
+
+// Slots using REFRESH_FAST draw their digits in pure black and white and are refreshed with the fast DU
+// waveform, the others in grayscale with GL16.
+enum SlotRefresh { REFRESH_GRAYSCALE, REFRESH_FAST };
+
+#define MONITOR_SLOT_HEIGHT             227
+
+// A slot is a horizontal band of the portrait screen, MONITOR_SLOT_HEIGHT px high, ending right above cursorY. Its
+// digits are right-aligned to cursorX.
+struct MonitorSlot {
+    int cursorX;
+    int cursorY;
+    SlotRefresh refresh;
+};
+
+// The panel columns spanned by the band of a slot, both included: portrait rows map to panel columns.
+struct SlotColumns {
+    int first;
+    int last;
+};
+
+SlotColumns slotColumns(const MonitorSlot & slot);
+
+// An image built at boot, 4bpp with the first pixel of a byte in its low nibble.
+struct LayoutImage {
+    const uint8_t * data;
+    int width;
+    int height;
+};
+
+// Returns zeroed memory for the images built at boot, in internal SRAM or in PSRAM. It is never freed.
+typedef void * (*LayoutAlloc)(size_t size, bool internal);
+
+// Builds the dash image, the large page digit atlas and the black and white copy of the digit font. Glyphs are
+// rasterized into scratch, a framebuffer that is not in use yet, and read back.
+void beginLayout(uint8_t * scratch, LayoutAlloc alloc);
+
+// Builds the alarm banner label of a metric: its name, up to three letters, scaled down by two, white on black.
+LayoutImage buildBannerLabel(const char * name, uint8_t * scratch, LayoutAlloc alloc);
+
+// Draws a value in a slot with the given decimals, preceded by a sign image if requested or if the value is
+// negative. Values are pinned to the digits of METRIC_DISPLAY_MAX, e.g. to 99.9 with one decimal.
+void drawSlotValue(uint8_t * fb, const MonitorSlot & slot, float value, int decimals, bool sign, EpdFontProperties & props);
+
+// Draws the dashes shown in place of the digits of a stale metric.
+void drawSlotDashes(uint8_t * fb, const MonitorSlot & slot);
+
+// Draws the first three letters of name, stacked vertically, on the left of the slot.
+void drawSlotLabel(uint8_t * fb, const MonitorSlot & slot, const char * name, EpdFontProperties & props);
+
+// Inverts the slot band, as for a metric in alarm.
+void invertSlot(uint8_t * fb, const MonitorSlot & slot);
+
+// What the slot of a metric shows on a frame.
+struct SlotFrame {
+    float value;
+    bool stale;
+    bool restored;
+    bool alarm;
+};
+
+// Draws a metric in its slot, as on the metrics page: its value, drawn in MONITOR_STALE_COLOR if restored after a
+// reset or replaced by dashes if stale or not finite, then its label, and the whole slot inverted on alarm.
+void drawSlot(uint8_t * fb, const MonitorSlot & slot, const char * name, int decimals, bool sign, const SlotFrame & frame, EpdFontProperties & props);
+
+// Draws up to four digits right-aligned on the large page grid, e.g. a countdown as minutes and seconds.
+void drawLargeDigits(uint8_t * fb, const char * digits);
+
+// Draws the minutes and seconds left as large digits, up to 99:59.
+void drawCountdown(uint8_t * fb, int64_t remainingMs);
+
+// Draws a value on the large page, with decimals only below 10 and a minus sign on the top row.
+void drawLargeValue(uint8_t * fb, float value, int decimals);
+
+// Draws the dashes shown in place of a stale value on the large page.
+void drawLargeDashes(uint8_t * fb);
+
+// Draws the alarm banner between the two digit rows of the large page, holding the given labels centered. Labels
+// that do not fit are left out, and nothing is drawn without labels.
+void drawAlarmBanner(uint8_t * fb, const LayoutImage * labels, int count);
@@ -0,0 +1,40 @@
+#include "MonitorMessages.h"
+#include <string.h>
+
+void storeMessagePaths(JsonVariantConst message, const JsonStreamPaths & paths, uint32_t candidates) {
+    for (int i = 0; i < paths.count; i++) {
+        if (!(candidates >> i & 1)) continue;
+        JsonVariantConst value = message;
+        int depth = 0;
+        const char * segment = paths.segment(i, depth);
+        while (segment && value.containsKey(segment)) {
+            value = value[segment];
+            segment = ++depth < paths.depth ? paths.segment(i, depth) : nullptr;
+        }
+        if (!segment && value.is<float>()) paths.store(i, value.as<float>());
+    }
+}
+
+bool readPageSelection(JsonObjectConst message, int (*findMetric)(const char * name), int64_t nowMs, PageSelection & selection) {
+    const char * name = message["page"] | "metrics";
+    if (!strcmp(name, "large")) {
+        selection.metric = findMetric(message["metric"] | "");
+        if (selection.metric < 0) return false;
+        selection.page = PAGE_LARGE_METRIC;
+    } else if (!strcmp(name, "countdown")) {
+        if (message.containsKey("start")) {
+            // Rejects NaN as well.
+            double start = message["start"].as<double>();
+            if (!(start >= 0 && start < 4102444800.0)) return false;
+            selection.countdownEndMs = (int64_t)(start * 1000);
+        } else {
+            long duration = message["duration"].as<long>();
+            duration = duration < 0 ? 0 : duration > MONITOR_COUNTDOWN_MAX_S ? MONITOR_COUNTDOWN_MAX_S : duration;
+            selection.countdownEndMs = nowMs + (int64_t)duration * 1000;
+        }
+        selection.page = PAGE_COUNTDOWN;
+    } else {
+        selection.page = PAGE_METRICS;
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <ArduinoJson.h>
+#include <JsonStream.h>
+
+// Messages of the monitor once decoded by ArduinoJson: MsgPack metric payloads and page selections. JSON metric
+// payloads are streamed by lib/JsonStream instead, into the same paths.
+
+#ifndef MONITOR_COUNTDOWN_MAX_S
+#define MONITOR_COUNTDOWN_MAX_S         5999
+#endif
+
+enum MonitorPage { PAGE_METRICS, PAGE_LARGE_METRIC, PAGE_COUNTDOWN };
+
+// The page selected by a message, with the metric shown by the large page or the end of the countdown, in
+// milliseconds of unix time.
+struct PageSelection {
+    MonitorPage page;
+    int metric;
+    int64_t countdownEndMs;
+};
+
+// Stores the numbers found at the candidate paths of a decoded message, as jsonStream() does for a raw payload:
+// null, strings, objects and arrays at the end of a path are ignored.
+void storeMessagePaths(JsonVariantConst message, const JsonStreamPaths & paths, uint32_t candidates);
+
+// Reads a page selection, e.g. { "page": "large", "metric": "sog" }, { "page": "countdown", "start": <unix
+// time> } or { "page": "countdown", "duration": <seconds> }, and { "page": "metrics" } to go back. findMetric()
+// returns the index of a metric from its dotted path, or -1, and countdown durations start at nowMs. Returns false
+// for messages to ignore: an unknown metric, or a start time that is not between 1970 and 2100.
+bool readPageSelection(JsonObjectConst message, int (*findMetric)(const char * name), int64_t nowMs, PageSelection & selection);
@@ -0,0 +1,141 @@
+# Generates the epdiy glyph tables in include/fonts from the source fonts in assets/fonts.
+#
+# Runs as a PlatformIO pre-build script (see extra_scripts in platformio.ini) or standalone with
+# `python scripts/build_fonts.py`. A header is regenerated only when its source font is present and either the
+# source or the font configuration below changed, so the checked-in headers keep building without the sources.
+#
+# Encodings:
+#   raw   4bpp bitmaps stored as-is, fastest to draw, largest in flash
+#   zlib  4bpp bitmaps compressed per glyph, decompressed by epdiy on every draw
+
+import os
+import sys
+import zlib
+
+try:
+    Import("env")
+    PROJECT_DIR = env.subst("$PROJECT_DIR")
+except NameError:
+    env = None
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+FONTS = [
+    {
+        "name": "Roboto_Bold_40",
+        "source": "assets/fonts/Roboto-Bold.ttf",
+        "size": 40,
+        "intervals": [(0x41, 0x5A)],
+        "encoding": "zlib",
+    },
+    {
+        "name": "DSEG14Classic_Regular_100",
+        "source": "assets/fonts/DSEG14Classic-Regular.ttf",
+        "size": 100,
+        "intervals": [(0x2D, 0x2E), (0x30, 0x39)],
+        "encoding": "zlib",
+    },
+]
+
+FONTS_DIR = os.path.join(PROJECT_DIR, "include", "fonts")
+DPI = 150
+
+
+def norm_floor(val):
+    return val >> 6
+
+
+def norm_ceil(val):
+    return (val + 63) >> 6
+
+
+def config_line(font):
+    intervals = ",".join("0x%X-0x%X" % interval for interval in font["intervals"])
+    return "// Generated by scripts/build_fonts.py: size=%d intervals=%s encoding=%s\n" % (
+        font["size"], intervals, font["encoding"])
+
+
+def pack_4bpp(bitmap):
+    # Two pixels per byte, first pixel in the low nibble, each row padded to a whole byte.
+    packed = bytearray()
+    for y in range(bitmap.rows):
+        row = bitmap.buffer[y * bitmap.pitch:y * bitmap.pitch + bitmap.width]
+        for x in range(0, bitmap.width, 2):
+            px = row[x] >> 4
+            if x + 1 < bitmap.width:
+                px |= row[x + 1] & 0xF0
+            packed.append(px)
+    return bytes(packed)
+
+
+def generate(font, source):
+    import freetype
+
+    face = freetype.Face(source)
+    face.set_char_size(font["size"] << 6, font["size"] << 6, DPI, DPI)
+
+    name = font["name"]
+    compressed = font["encoding"] == "zlib"
+    bitmaps = bytearray()
+    glyphs = []
+    intervals = []
+    for first, last in font["intervals"]:
+        intervals.append((first, last, len(glyphs)))
+        for code_point in range(first, last + 1):
+            face.load_char(chr(code_point), freetype.FT_LOAD_RENDER)
+            bitmap = face.glyph.bitmap
+            packed = pack_4bpp(bitmap)
+            data = zlib.compress(packed) if compressed else packed
+            glyphs.append((bitmap.width, bitmap.rows, norm_floor(face.glyph.advance.x), face.glyph.bitmap_left,
+                           face.glyph.bitmap_top, len(data), len(bitmaps), code_point))
+            bitmaps += data
+
+    out = [config_line(font), "#pragma once\n", "#include \"epd_driver.h\"\n"]
+    out.append("const uint8_t %sBitmaps[%d] = {\n" % (name, len(bitmaps)))
+    for i in range(0, len(bitmaps), 16):
+        out.append("    " + " ".join("0x%02X," % b for b in bitmaps[i:i + 16]) + "\n")
+    out.append("};\n")
+    out.append("const EpdGlyph %sGlyphs[] = {\n" % name)
+    for glyph in glyphs:
+        out.append("    { %d, %d, %d, %d, %d, %d, %d }, // %s\n" % (glyph[:7] + (chr(glyph[7]),)))
+    out.append("};\n")
+    out.append("const EpdUnicodeInterval %sIntervals[] = {\n" % name)
+    for interval in intervals:
+        out.append("    { 0x%X, 0x%X, 0x%X },\n" % interval)
+    out.append("};\n")
+    out.append("const EpdFont %s = {\n" % name)
+    for field in ("%sBitmaps" % name, "%sGlyphs" % name, "%sIntervals" % name, len(intervals), int(compressed),
+                  norm_ceil(face.size.height), norm_ceil(face.size.ascender), norm_floor(face.size.descender)):
+        out.append("    %s,\n" % field)
+    out.append("};\n")
+    return "".join(out)
+
+
+def up_to_date(font, source, header):
+    if not os.path.exists(header) or os.path.getmtime(header) < os.path.getmtime(source):
+        return False
+    with open(header) as f:
+        return f.readline() == config_line(font)
+
+
+def ensure_freetype():
+    try:
+        import freetype
+    except ImportError:
+        if env is None:
+            sys.exit("freetype-py is required: pip install freetype-py")
+        env.Execute("$PYTHONEXE -m pip install freetype-py")
+
+
+def build_fonts():
+    for font in FONTS:
+        source = os.path.join(PROJECT_DIR, font["source"])
+        header = os.path.join(FONTS_DIR, font["name"] + ".h")
+        if not os.path.exists(source) or up_to_date(font, source, header):
+            continue
+        ensure_freetype()
+        print("Generating %s from %s" % (os.path.relpath(header, PROJECT_DIR), font["source"]))
+        with open(header, "w") as f:
+            f.write(generate(font, source))
+
+
+build_fonts()
@@ -0,0 +1,14 @@
+# Builds the fuzz environment (see platformio.ini) with clang, libFuzzer and the address and undefined behaviour
+# sanitizers, the libraries included. Runs as a PlatformIO pre-build script.
+
+Import("env")
+
+SANITIZE_FLAGS = [
+    "-fsanitize=fuzzer,address,undefined,float-cast-overflow",
+    "-fno-sanitize-recover=all",
+    "-g",
+    "-O1",
+]
+
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+env.Append(CCFLAGS=SANITIZE_FLAGS, LINKFLAGS=SANITIZE_FLAGS)
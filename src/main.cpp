@@ -3,11 +3,21 @@
 #include <SailtrackModule.h>
 #include <epd_driver.h>
 #include <epd_highlevel.h>
-#include "fonts/DSEG14Classic_Regular_100.h"
-#include "fonts/Roboto_Bold_40.h"
+#include <mqtt_client.h>
+#include <new>
+#include <sys/time.h>
+#include <WiFi.h>
+#include <Framebuffer.h>
+#include <IngestQueue.h>
+#include <JsonStream.h>
+#include <MetricProgram.h>
+#include <MonitorLayout.h>
+#include <MonitorMessages.h>
+#include <MonitorMetrics.h>
+#ifdef MONITOR_REPLAY_SPEED
+#include <LittleFS.h>
+#endif
 #include "images/SailtrackLogo.h"
-#include "images/SignsMinus.h"
-#include "images/SignsPlus.h"
 
 // -------------------------- Configuration -------------------------- //
 
@@ -20,40 +30,100 @@
 #define BATTERY_NUM_READINGS            32
 #define BATTERY_READING_DELAY_MS	    20
 
-#define METRIC_MULTIPLIER_IDENTITY      1
+// SailTrack Network: the SailTrack Core runs the MQTT broker and the NTP server. Besides the SailtrackModule
+// connection, metric topics are received by a second MQTT session (see beginIngest()), which must use the same
+// credentials as SailtrackModule and a client id of its own, suffixed with the MAC address to stay unique per monitor.
+#define NETWORK_MODULE_NAME             "monitor"
+#define NETWORK_MODULE_IP               IPAddress(192, 168, 42, 103)
+#define NETWORK_CORE_ADDRESS            "192.168.42.1"
+#define NETWORK_MQTT_USERNAME           "mosquitto"
+#define NETWORK_MQTT_PASSWORD           "sailtrack"
+
+#define INGEST_MQTT_URI                 "mqtt://" NETWORK_CORE_ADDRESS
+#define INGEST_MQTT_CLIENT_ID_PREFIX    NETWORK_MODULE_NAME "-ingest-"
+#define INGEST_DOC_SIZE                 1024
+#define INGEST_BOOTSTRAP_TIMEOUT_MS     1500
+
+// The metrics, their topics and their slots are listed in include/MonitorMetrics.h.
+#define METRIC_TIMEOUT_MS               5000
+#define METRIC_MAX_INSTRUCTIONS         64
+#define METRIC_SIN_TABLE_SIZE           256
 
-#define MONITOR_SLOT_0                  { 470, 227 }
-#define MONITOR_SLOT_1                  { 470, 454 }
-#define MONITOR_SLOT_2                  { 470, 681 }
-#define MONITOR_SLOT_3                  { 470, 908 }
 #define MONITOR_WAVEFORM                EPD_BUILTIN_WAVEFORM
-#define MONITOR_CLEAR_INTERVAL_UPDATES  600
+#define MONITOR_CLEANUP_UPDATES         100
+#define MONITOR_CLEANUP_MAX_UPDATES     300
+#define MONITOR_CLEANUP_CYCLES          1
+#define MONITOR_CLEANUP_CYCLE_TIME      10
 #define MONITOR_TEMPERATURE_CELSIUS     40
+// The loop task runs on core 1 and draws half of the slots while the render task draws the other half on core 0.
+// The refresh task diffs the frame right after the handoff, while the loop task waits for its next frame, so it
+// shares core 1 with the loop task and never preempts the render task.
+#define MONITOR_RENDER_TASK_CORE        0
+#define MONITOR_RENDER_TASK_PRIORITY    1
+#define MONITOR_RENDER_TASK_STACK_SIZE  4096
+#define MONITOR_REFRESH_TASK_CORE       1
+#define MONITOR_REFRESH_TASK_PRIORITY   2
+#define MONITOR_REFRESH_TASK_STACK_SIZE 4096
+#define MONITOR_NETWORK_TASK_CORE       0
+#define MONITOR_NETWORK_TASK_PRIORITY   1
+#define MONITOR_NETWORK_TASK_STACK_SIZE 8192
+#define MONITOR_INTERNAL_ARENA_SIZE     4096
+#define MONITOR_PSRAM_ARENA_SIZE        (1024 * 1024)
+#define MONITOR_DIFF_MERGE_ROWS         16
+#define MONITOR_DIFF_MAX_AREAS          4
+#define MONITOR_NTP_SERVER              NETWORK_CORE_ADDRESS
+#define MONITOR_COUNTDOWN_LEAD_MS       250
 
-#define LOOP_TASK_INTERVAL_MS           1000 / MONITOR_UPDATE_FREQ_HZ
+// Replay mode is enabled by defining MONITOR_REPLAY_SPEED (see the LilyGo_EPD47_replay environment):
+// 1 replays at recorded speed, 10 ten times faster, 0 as fast as possible.
+#define MONITOR_REPLAY_FILE             "/replay.jsonl"
+#define MONITOR_REPLAY_LINE_SIZE        4096
+#define MONITOR_REPLAY_REPORT_MS        1000
+#define MONITOR_REPLAY_TASK_PRIORITY    1
+#define MONITOR_REPLAY_TASK_STACK_SIZE  8192
 
-enum MetricType { SPEED, ANGLE, ANGLE_ZERO_CENTERED };
+// Duty-cycled mode is enabled by defining MONITOR_SLEEP_INTERVAL_S (see the LilyGo_EPD47_sleep environment): the
+// monitor wakes up every MONITOR_SLEEP_INTERVAL_S seconds, waits up to MONITOR_SLEEP_AWAKE_MS after connecting for
+// fresh values, updates the panel once and goes back to deep sleep. A wake up that cannot connect ends after
+// MONITOR_SLEEP_MAX_AWAKE_MS.
+#define MONITOR_SLEEP_AWAKE_MS          5000
+#define MONITOR_SLEEP_MAX_AWAKE_MS      30000
+#define MONITOR_SLEEP_INGEST_QOS        1
 
-struct MonitorSlot {
-    int cursorX;
-    int cursorY;
-};
+#define LOOP_TASK_INTERVAL_MS           1000 / MONITOR_UPDATE_FREQ_HZ
 
-struct MonitorMetric {
+struct MetricState {
     float value;
-    char topic[32];
-    char name[32];
-    char displayName[8];
-    double multiplier;
-    MetricType type;
-    MonitorSlot slot;
-} monitorMetrics[] = {
-    { 0, "boat", "sog", "SOG", METRIC_MULTIPLIER_IDENTITY, SPEED, MONITOR_SLOT_0 },
-    { 0, "boat", "drift", "DFT", METRIC_MULTIPLIER_IDENTITY, ANGLE_ZERO_CENTERED, MONITOR_SLOT_1 },
-    { 0, "boat", "pitch", "PTC", METRIC_MULTIPLIER_IDENTITY, ANGLE_ZERO_CENTERED, MONITOR_SLOT_2 },
-    { 0, "boat", "roll", "RLL", METRIC_MULTIPLIER_IDENTITY, ANGLE_ZERO_CENTERED, MONITOR_SLOT_3 }
+    unsigned long updateTime;
+    float sum;
+    float sinSum;
+    float cosSum;
+    int samples;
+    int programStart;
+    int programLength;
+    bool alarm;
+    bool alarmPending;
+    bool restored;
+};
+
+// Working memory is reserved in one block per arena at boot and handed out by bump allocation, so the heap does
+// not fragment over long deployments. Nothing is ever freed, hence the used size of an arena is its peak use.
+struct MemoryArena {
+    const char * name;
+    uint32_t caps;
+    size_t size;
+    uint8_t * base;
+    size_t used;
 };
 
+template <MetricType T> void sampleMetric(MetricState & state, float value);
+template <MetricType T> void aggregateMetric(MetricState & state);
+void updatePage(JsonObjectConst message);
+
+// Sampling and aggregation functions of each metric type.
+void (* const metricSamplers[])(MetricState & state, float value) = { sampleMetric<SPEED>, sampleMetric<ANGLE>, sampleMetric<ANGLE_ZERO_CENTERED> };
+void (* const metricAggregators[])(MetricState & state) = { aggregateMetric<SPEED>, aggregateMetric<ANGLE>, aggregateMetric<ANGLE_ZERO_CENTERED> };
+
 // ------------------------------------------------------------------- //
 
 SailtrackModule stm;
@@ -61,9 +131,535 @@ SailtrackModule stm;
 EpdFontProperties fontProps = epd_font_properties_default();
 EpdRotation orientation = EPD_ROT_PORTRAIT;
 EpdiyHighlevelState hl;
-int updateCycles = 0;
 uint8_t *fb;
 
+// Hot small structures live in internal SRAM, framebuffers and image atlases in PSRAM.
+MemoryArena internalArena = { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MONITOR_INTERNAL_ARENA_SIZE };
+MemoryArena psramArena = { "psram", MALLOC_CAP_SPIRAM, MONITOR_PSRAM_ARENA_SIZE };
+portMUX_TYPE arenaMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Reset reasons are counted in RTC memory, which keeps its content across every reset but a power loss.
+const uint32_t resetCountsMagic = 0x5E7C0DE5;
+RTC_NOINIT_ATTR uint32_t resetCountsCheck;
+RTC_NOINIT_ATTR uint32_t resetCounts[ESP_RST_SDIO + 1];
+const char * const resetNames[] = { "unknown", "poweron", "external", "software", "panic", "interrupt_wdt", "task_wdt", "wdt", "deepsleep", "brownout", "sdio" };
+
+MetricState metricStates[metricsCount];
+
+// Content of the last frame, saved in RTC memory on every frame and drawn again right after a reset, before the
+// network is up. The check word also covers the metrics count, so a snapshot from another table is ignored.
+struct MonitorSnapshot {
+    uint32_t check;
+    MonitorPage page;
+    int largeMetric;
+    int64_t countdownEndMs;
+    float values[metricsCount];
+    bool valid[metricsCount];
+    bool restored[metricsCount];
+    bool alarm[metricsCount];
+};
+
+const uint32_t snapshotMagic = 0x5A11F4A3 ^ metricsCount;
+RTC_NOINIT_ATTR MonitorSnapshot snapshot;
+
+TaskHandle_t loopTaskHandle;
+TaskHandle_t renderTaskHandle;
+SemaphoreHandle_t renderDone;
+TaskHandle_t refreshTaskHandle;
+SemaphoreHandle_t refreshDone;
+volatile bool refreshFast;
+volatile uint32_t refreshSlots;
+volatile uint32_t refreshAlarms;
+volatile MonitorPage refreshPage;
+uint32_t alarmChanges;
+volatile bool networkStarted;
+unsigned long networkStartTime;
+int fastUpdates[metricsCount];
+EpdRect slowArea;
+int slowUpdates;
+uint32_t dirtyRows[(EPD_HEIGHT + 31) / 32];
+
+// Alarm banner labels of the metrics that can raise an alarm, shown on the large pages.
+LayoutImage bannerLabels[metricsCount];
+
+volatile MonitorPage page = PAGE_METRICS;
+volatile int largeMetric;
+volatile int64_t countdownEndMs;
+
+esp_mqtt_client_handle_t ingestClient;
+
+// Latest payload received on each metric topic, filled by the ingest client and taken by the loop task.
+IngestSlot ingestSlots[topicsCount];
+SemaphoreHandle_t ingestMutex;
+IngestCounters ingestCounters;
+unsigned long ingestParseUs;
+unsigned long ingestSampleUs;
+unsigned long ingestDisconnects;
+unsigned long wifiDisconnects;
+unsigned long mqttDisconnects;
+unsigned long frameCount;
+volatile bool bootstrapping;
+unsigned long bootstrapTime;
+uint32_t bootstrapTopics;
+portMUX_TYPE metricsMux = portMUX_INITIALIZER_UNLOCKED;
+float sinTable[METRIC_SIN_TABLE_SIZE + 1];
+
+void beginArena(MemoryArena & arena) {
+    arena.base = (uint8_t *)heap_caps_aligned_calloc(16, arena.size, 1, arena.caps);
+    if (!arena.base) arena.size = 0;
+}
+
+// Returns zeroed memory, 16-byte aligned for the vector framebuffer kernels, valid for the whole runtime. Arena
+// sizes are fixed at build time, so running out of space is a configuration error.
+void * arenaAlloc(MemoryArena & arena, size_t size) {
+    void * block = nullptr;
+    size = (size + 15) & ~(size_t)15;
+    portENTER_CRITICAL(&arenaMux);
+    if (arena.used + size <= arena.size) {
+        block = arena.base + arena.used;
+        arena.used += size;
+    }
+    portEXIT_CRITICAL(&arenaMux);
+    if (!block) {
+        log_e("%s arena exhausted: %u bytes requested, %u of %u used", arena.name, size, arena.used, arena.size);
+        abort();
+    }
+    return block;
+}
+
+// ArduinoJson allocator for documents that are created once and reused for every message.
+template <MemoryArena & A>
+struct ArenaAllocator {
+    void * allocate(size_t size) { return arenaAlloc(A, size); }
+    void deallocate(void * block) {}
+    void * reallocate(void * block, size_t size) { return nullptr; }
+};
+
+typedef BasicJsonDocument<ArenaAllocator<internalArena>> InternalJsonDocument;
+typedef BasicJsonDocument<ArenaAllocator<psramArena>> PsramJsonDocument;
+
+// Documents used by the ingest path, created at boot by beginIngestQueue() so that their memory is reserved before
+// the first message arrives: sampleDoc decodes MsgPack payloads on arrival, ingestDoc at frame time, and pageDoc
+// the page topic in duty-cycled mode.
+InternalJsonDocument * sampleDoc;
+InternalJsonDocument * ingestDoc;
+InternalJsonDocument * pageDoc;
+
+InternalJsonDocument * newInternalDocument(size_t capacity) {
+    return new (arenaAlloc(internalArena, sizeof(InternalJsonDocument))) InternalJsonDocument(capacity);
+}
+
+void beginResetCounts() {
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (resetCountsCheck != resetCountsMagic || reason == ESP_RST_POWERON) {
+        memset(resetCounts, 0, sizeof(resetCounts));
+        resetCountsCheck = resetCountsMagic;
+    }
+    if (reason <= ESP_RST_SDIO) resetCounts[reason]++;
+}
+
+void beginMemory() {
+    beginArena(internalArena);
+    beginArena(psramArena);
+}
+
+void beginSinTable() {
+    for (int i = 0; i <= METRIC_SIN_TABLE_SIZE; i++)
+        sinTable[i] = sinf(2 * PI * i / METRIC_SIN_TABLE_SIZE);
+}
+
+// Linear interpolation in the sine table, accurate to about 1e-4 with 256 entries.
+float fastSin(float degrees) {
+    float pos = (degrees - 360 * floorf(degrees / 360)) * METRIC_SIN_TABLE_SIZE / 360;
+    int i = min((int)pos, METRIC_SIN_TABLE_SIZE - 1);
+    return sinTable[i] + (pos - i) * (sinTable[i + 1] - sinTable[i]);
+}
+
+float fastCos(float degrees) {
+    return fastSin(degrees + 90);
+}
+
+template <MetricType T>
+void sampleMetric(MetricState & state, float value) {
+    if (MetricTraits<T>::circular) {
+        state.sinSum += fastSin(value);
+        state.cosSum += fastCos(value);
+    } else {
+        state.sum += value;
+    }
+    state.samples++;
+}
+
+// Angles are averaged on the unit circle, so that samples around the 359°/0° (or ±180°) wrap don't average
+// to the opposite side.
+template <MetricType T>
+void aggregateMetric(MetricState & state) {
+    if (MetricTraits<T>::circular) {
+        float angle = atan2f(state.sinSum, state.cosSum) * RAD_TO_DEG;
+        state.value = MetricTraits<T>::fullCircle && angle < 0 ? angle + 360 : angle;
+    } else {
+        state.value = state.sum / state.samples;
+    }
+}
+
+// Restored metrics hold the value shown before the last reset and are stale until fresh data arrives.
+bool metricStale(const MetricState & state) {
+    return state.restored || !state.updateTime || millis() - state.updateTime > METRIC_TIMEOUT_MS;
+}
+
+void storeMetric(int i, float value) {
+    const MonitorMetric & metric = monitorMetrics[i];
+    MetricState & state = metricStates[i];
+    if (!scaleMetric(metric, value)) return;
+    bool alarm = metricAlarm(metric, value);
+    portENTER_CRITICAL(&metricsMux);
+    if (metric.aggregated) metricSamplers[metric.type](state, value);
+    else state.value = value;
+    state.updateTime = millis();
+    state.restored = false;
+    bool raised = alarm && !state.alarm && !state.alarmPending;
+    state.alarmPending |= alarm;
+    portEXIT_CRITICAL(&metricsMux);
+    // Wake the loop task right away instead of waiting for the next frame, unless it is the one parsing.
+    if (raised && !bootstrapping && xTaskGetCurrentTaskHandle() != loopTaskHandle) xTaskNotifyGive(loopTaskHandle);
+}
+
+static_assert(metricsCount <= 32, "metric candidates are tracked in a 32-bit mask");
+static_assert(topicsCount < 32, "retained topics are tracked in a 32-bit mask");
+
+const char * metricSegment(int metric, int depth) {
+    return monitorMetrics[metric].path.segments[depth];
+}
+
+// Payloads are stored straight into the metric states: JSON is streamed, MsgPack decoded into a document first.
+const JsonStreamPaths metricPaths = { metricsCount, METRIC_PATH_DEPTH, metricSegment, storeMetric };
+
+// Metrics of each topic, and the ones among them parsed as soon as a payload arrives: aggregated metrics need
+// every sample, and metrics with alarm thresholds raise their alarm right away (see storeMetric()). The others
+// are parsed once per frame from the latest payload of their topic, through its ingest slot.
+uint32_t topicMetrics[topicsCount];
+uint32_t sampledMetrics;
+
+void parseIngest(int topic, const char * data, size_t len, uint32_t candidates, InternalJsonDocument * doc) {
+    if (!candidates) return;
+    if (monitorTopics[topic].format == JSON) {
+        jsonStream(data, len, metricPaths, candidates);
+    } else {
+        if (!deserializeMsgPack(*doc, data, len)) storeMessagePaths(doc->as<JsonVariantConst>(), metricPaths, candidates);
+    }
+}
+
+// Parses the sampled metrics of a payload right away and queues it until the next frame for the other ones.
+void queueIngest(int topic, const char * data, size_t len) {
+    unsigned long parseStart = micros();
+    parseIngest(topic, data, len, topicMetrics[topic] & sampledMetrics, sampleDoc);
+    unsigned long parseUs = micros() - parseStart;
+    xSemaphoreTake(ingestMutex, portMAX_DELAY);
+    ingestSampleUs += parseUs;
+    ingestPush(ingestSlots[topic], ingestCounters, data, len, topicMetrics[topic] & ~sampledMetrics, millis());
+    xSemaphoreGive(ingestMutex);
+}
+
+// Parses the payloads queued since the previous frame, outside of the lock. The time spent parsing since the
+// previous frame, on arrival included, is kept in ingestParseUs.
+void drainIngestQueue() {
+    unsigned long start = micros();
+    unsigned long sampleUs = 0;
+    for (int i = 0; i < topicsCount; i++) {
+        IngestSlot & slot = ingestSlots[i];
+        xSemaphoreTake(ingestMutex, portMAX_DELAY);
+        size_t len = ingestTake(slot);
+        sampleUs += ingestSampleUs;
+        ingestSampleUs = 0;
+        xSemaphoreGive(ingestMutex);
+        if (len) parseIngest(i, slot.parsing, len, topicMetrics[i] & ~sampledMetrics, ingestDoc);
+    }
+    ingestParseUs = micros() - start + sampleUs;
+}
+
+void beginIngestQueue() {
+    ingestMutex = xSemaphoreCreateMutex();
+    for (auto & slot : ingestSlots) {
+        slot.pending = (char *)arenaAlloc(psramArena, INGEST_BUFFER_SIZE);
+        slot.parsing = (char *)arenaAlloc(psramArena, INGEST_BUFFER_SIZE);
+    }
+    for (int i = 0; i < metricsCount; i++) {
+        const MonitorMetric & metric = monitorMetrics[i];
+        if (metric.aggregated || metric.alarmMin != -INFINITY || metric.alarmMax != INFINITY) sampledMetrics |= 1u << i;
+    }
+    for (int i = 0; i < topicsCount; i++) {
+        topicMetrics[i] = metricsOfTopic(monitorTopics[i].topic);
+        if (monitorTopics[i].format != MSGPACK) continue;
+        if (topicMetrics[i] & sampledMetrics && !sampleDoc) sampleDoc = newInternalDocument(INGEST_DOC_SIZE);
+        if (topicMetrics[i] & ~sampledMetrics && !ingestDoc) ingestDoc = newInternalDocument(INGEST_DOC_SIZE);
+    }
+#ifdef MONITOR_SLEEP_INTERVAL_S
+    pageDoc = newInternalDocument(INGEST_DOC_SIZE);
+#endif
+}
+
+// SailtrackModule only delivers messages decoded into a JSON document, so metric topics are received by a
+// dedicated MQTT client that hands over the raw payload to queueIngest(): JSON is streamed straight into the metric
+// states, MsgPack is decoded into a bounded document. On every (re)connection, the retained messages delivered with the
+// subscriptions are collected while the loop task holds its frames (see bootstrapPending()), so the whole
+// catch-up reaches the panel in a single frame.
+void ingestEventHandler(void * handlerArgs, esp_event_base_t base, int32_t eventId, void * eventData) {
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)eventData;
+    switch ((esp_mqtt_event_id_t)eventId) {
+        case MQTT_EVENT_CONNECTED:
+#ifdef MONITOR_SLEEP_INTERVAL_S
+            // Subscribing again on every wake up also delivers the retained values.
+            esp_mqtt_client_subscribe(ingestClient, MONITOR_PAGE_TOPIC, MONITOR_SLEEP_INGEST_QOS);
+            for (auto & topic : monitorTopics)
+                esp_mqtt_client_subscribe(ingestClient, topic.topic, MONITOR_SLEEP_INGEST_QOS);
+#else
+            for (auto & topic : monitorTopics)
+                esp_mqtt_client_subscribe(ingestClient, topic.topic, 0);
+#endif
+            bootstrapTopics = 0;
+            bootstrapTime = millis();
+            bootstrapping = true;
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            ingestDisconnects++;
+            break;
+        case MQTT_EVENT_DATA: {
+            char topic[sizeof(monitorTopics[0].topic)];
+            if (!ingestEventTopic(event->topic, event->topic_len, event->current_data_offset, event->data_len, event->total_data_len, topic, sizeof(topic))) break;
+            int topicIndex = findTopic(topic);
+#ifdef MONITOR_SLEEP_INTERVAL_S
+            if (!strcmp(topic, MONITOR_PAGE_TOPIC)) {
+                if (!deserializeJson(*pageDoc, event->data, event->data_len)) updatePage(pageDoc->as<JsonObjectConst>());
+                break;
+            }
+#endif
+            if (topicIndex < 0) break;
+            queueIngest(topicIndex, event->data, event->data_len);
+            if (bootstrapping && event->retain) {
+                bootstrapTopics |= 1u << topicIndex;
+                if (bootstrapTopics == (1u << topicsCount) - 1) {
+                    bootstrapping = false;
+                    xTaskNotifyGive(loopTaskHandle);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Returns whether the loop task should hold its frame because retained messages are still expected. Topics
+// without a retained message end the bootstrap by timeout.
+bool bootstrapPending() {
+    if (bootstrapping && millis() - bootstrapTime >= INGEST_BOOTSTRAP_TIMEOUT_MS) bootstrapping = false;
+    return bootstrapping;
+}
+
+// In duty-cycled mode the ingest client keeps a persistent session and also receives the page topic, since
+// SailtrackModule is not started on timer wake ups.
+void beginIngest() {
+    esp_mqtt_client_config_t config = {};
+#ifdef MONITOR_SLEEP_INTERVAL_S
+    config.disable_clean_session = true;
+#else
+    stm.subscribe(MONITOR_PAGE_TOPIC);
+#endif
+    static char clientId[sizeof(INGEST_MQTT_CLIENT_ID_PREFIX) + 12];
+    snprintf(clientId, sizeof(clientId), INGEST_MQTT_CLIENT_ID_PREFIX "%012llx", (unsigned long long)ESP.getEfuseMac());
+    config.uri = INGEST_MQTT_URI;
+    config.client_id = clientId;
+    config.username = NETWORK_MQTT_USERNAME;
+    config.password = NETWORK_MQTT_PASSWORD;
+    config.buffer_size = INGEST_BUFFER_SIZE;
+    ingestClient = esp_mqtt_client_init(&config);
+    esp_mqtt_client_register_event(ingestClient, MQTT_EVENT_ANY, ingestEventHandler, NULL);
+    esp_mqtt_client_start(ingestClient);
+}
+
+// Replaces the value of each aggregated metric with the mean of the samples received since the previous frame.
+void aggregateMetrics() {
+    portENTER_CRITICAL(&metricsMux);
+    for (int i = 0; i < metricsCount; i++) {
+        MetricState & state = metricStates[i];
+        if (!state.samples) continue;
+        metricAggregators[monitorMetrics[i].type](state);
+        state.sum = state.sinSum = state.cosSum = 0;
+        state.samples = 0;
+    }
+    portEXIT_CRITICAL(&metricsMux);
+}
+
+// Updates the alarm state of every metric from its displayed value and any out-of-range sample received since
+// the previous frame. Returns whether an alarm was raised, in which case the frame is refreshed in fast mode.
+// Metrics whose alarm state changed are collected in alarmChanges until the next frame is handed to the panel.
+bool updateAlarms() {
+    bool raised = false;
+    portENTER_CRITICAL(&metricsMux);
+    for (int i = 0; i < metricsCount; i++) {
+        const MonitorMetric & metric = monitorMetrics[i];
+        MetricState & state = metricStates[i];
+        bool alarm = state.alarmPending || state.value < metric.alarmMin || state.value > metric.alarmMax;
+        alarm &= !metricStale(state);
+        raised |= alarm && !state.alarm;
+        if (alarm != state.alarm) alarmChanges |= 1u << i;
+        state.alarm = alarm;
+        state.alarmPending = false;
+    }
+    portEXIT_CRITICAL(&metricsMux);
+    return raised;
+}
+
+MetricInstruction metricInstructions[METRIC_MAX_INSTRUCTIONS];
+int metricInstructionsCount;
+
+// Compiles the expression of a derived metric into a slice of the flat instruction array. Metrics that fail to
+// compile are never updated and show as stale.
+bool compileMetric(const MonitorMetric & metric, MetricState & state) {
+    int length;
+    if (!compileMetricProgram(metric.expression, findMetric, metricInstructions + metricInstructionsCount, METRIC_MAX_INSTRUCTIONS - metricInstructionsCount, &length)) return false;
+    state.programStart = metricInstructionsCount;
+    state.programLength = length;
+    metricInstructionsCount += length;
+    return true;
+}
+
+void beginDerivedMetrics() {
+    for (int i = 0; i < metricsCount; i++) {
+        if (!monitorMetrics[i].expression) continue;
+        if (!compileMetric(monitorMetrics[i], metricStates[i])) {
+            log_e("Invalid expression for metric %s: %s", monitorMetrics[i].displayName, monitorMetrics[i].expression);
+            metricStates[i].programLength = 0;
+        }
+    }
+}
+
+// Stale inputs, never received ones included, read as NaN.
+float metricInput(int metric) {
+    const MetricState & state = metricStates[metric];
+    return metricStale(state) ? NAN : state.value;
+}
+
+// Runs once per frame on the current values. A derived metric is as old as its oldest input. While an input is
+// stale, the derived metric keeps its last value, restored ones included, and is drawn stale as well.
+void evaluateDerivedMetrics() {
+    for (int m = 0; m < metricsCount; m++) {
+        MetricState & state = metricStates[m];
+        if (!state.programLength) continue;
+        MetricInstruction * program = metricInstructions + state.programStart;
+        unsigned long updateTime = millis();
+        bool restored = false;
+        bool stale = false;
+        for (int i = 0; i < state.programLength; i++) {
+            if (program[i].op != OP_METRIC) continue;
+            const MetricState & input = metricStates[program[i].metric];
+            if ((long)(input.updateTime - updateTime) < 0) updateTime = input.updateTime;
+            restored |= input.restored;
+            stale |= metricStale(input);
+        }
+        if (!stale) state.value = runMetricProgram(program, state.programLength, metricInput) * monitorMetrics[m].multiplier;
+        state.updateTime = updateTime;
+        state.restored = restored;
+    }
+}
+
+int64_t timeMs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Selects the page to show (see readPageSelection()).
+void updatePage(JsonObjectConst message) {
+    PageSelection selection;
+    if (!readPageSelection(message, findMetric, timeMs(), selection)) return;
+    if (selection.page == PAGE_LARGE_METRIC) largeMetric = selection.metric;
+    if (selection.page == PAGE_COUNTDOWN) countdownEndMs = selection.countdownEndMs;
+    page = selection.page;
+}
+
+// Saves the metric states as they are drawn in the current frame.
+void saveSnapshot() {
+    snapshot.page = page;
+    snapshot.largeMetric = largeMetric;
+    snapshot.countdownEndMs = countdownEndMs;
+    for (int i = 0; i < metricsCount; i++) {
+        const MetricState & state = metricStates[i];
+        snapshot.valid[i] = state.restored || !metricStale(state);
+        snapshot.restored[i] = state.restored;
+        snapshot.alarm[i] = state.alarm;
+        if (snapshot.valid[i]) snapshot.values[i] = state.value;
+    }
+    snapshot.check = snapshotMagic;
+}
+
+// Returns whether the frame shown before the reset was restored. RTC memory is lost on power-on.
+bool restoreSnapshot() {
+    if (snapshot.check != snapshotMagic || esp_reset_reason() == ESP_RST_POWERON) return false;
+    if (snapshot.largeMetric < 0 || snapshot.largeMetric >= metricsCount) return false;
+    page = snapshot.page;
+    largeMetric = snapshot.largeMetric;
+    countdownEndMs = snapshot.countdownEndMs;
+    for (int i = 0; i < metricsCount; i++) {
+        metricStates[i].value = snapshot.values[i];
+        metricStates[i].restored = snapshot.valid[i];
+    }
+    return true;
+}
+
+void reportArena(JsonObject memory, const MemoryArena & arena) {
+    JsonObject report = memory.createNestedObject(arena.name);
+    report["size"] = arena.size;
+    report["peak"] = arena.used;
+}
+
+void reportHeap(JsonObject heap, const char * name, uint32_t caps) {
+    JsonObject report = heap.createNestedObject(name);
+    report["free"] = heap_caps_get_free_size(caps);
+    report["largest"] = heap_caps_get_largest_free_block(caps);
+    report["minimum"] = heap_caps_get_minimum_free_size(caps);
+}
+
+// Free bytes left at the deepest point reached by the stack of each monitor task.
+void reportStacks(JsonObject stack) {
+    TaskHandle_t tasks[] = { loopTaskHandle, renderTaskHandle, refreshTaskHandle };
+    for (auto task : tasks)
+        if (task) stack[pcTaskGetName(task)] = uxTaskGetStackHighWaterMark(task);
+}
+
+void reportResets(JsonObject resets) {
+    resets["last"] = resetNames[min((int)esp_reset_reason(), (int)ESP_RST_SDIO)];
+    for (int i = 0; i <= ESP_RST_SDIO; i++)
+        if (resetCounts[i]) resets[resetNames[i]] = resetCounts[i];
+}
+
+// Frames drawn per second since the previous status.
+float reportRate(JsonObject rate) {
+    static unsigned long lastFrameCount, lastTime;
+    unsigned long now = millis();
+    float frames = now > lastTime ? (frameCount - lastFrameCount) * 1000.0f / (now - lastTime) : 0;
+    lastFrameCount = frameCount;
+    lastTime = now;
+    rate["frames"] = frames;
+    return frames;
+}
+
+// Each topic carries the rate hint for its publishers: a sample arriving faster than the panel refreshes is at
+// best averaged with the others of its frame (see metric()), so it is wasted airtime on a weak link.
+void reportLink(JsonObject link, float frames) {
+    link["rssi"] = WiFi.RSSI();
+    link["wifiDisconnects"] = wifiDisconnects;
+    link["mqttDisconnects"] = mqttDisconnects;
+    link["ingestDisconnects"] = ingestDisconnects;
+    JsonObject topics = link.createNestedObject("topics");
+    for (int i = 0; i < topicsCount; i++) {
+        JsonObject topic = topics.createNestedObject(monitorTopics[i].topic);
+        topic["interval"] = ingestSlots[i].interval;
+        topic["jitter"] = ingestSlots[i].jitter;
+        if (topicMetrics[i]) topic["desired"] = max(1, (int)ceilf(frames));
+    }
+}
+
 class ModuleCallbacks: public SailtrackModuleCallbacks {
     void onStatusPublish(JsonObject status) {
 		JsonObject battery = status.createNestedObject("battery");
@@ -73,86 +669,557 @@ class ModuleCallbacks: public SailtrackModuleCallbacks {
 			delay(BATTERY_READING_DELAY_MS);
 		}
 		battery["voltage"] = 2 * avg / BATTERY_ADC_RESOLUTION * BATTERY_ESP32_REF_VOLTAGE * BATTERY_ADC_REF_VOLTAGE;
+		JsonObject memory = status.createNestedObject("memory");
+		reportArena(memory, internalArena);
+		reportArena(memory, psramArena);
+		JsonObject heap = status.createNestedObject("heap");
+		reportHeap(heap, "internal", MALLOC_CAP_INTERNAL);
+		reportHeap(heap, "psram", MALLOC_CAP_SPIRAM);
+		reportStacks(status.createNestedObject("stack"));
+		reportResets(status.createNestedObject("resets"));
+		JsonObject ingest = status.createNestedObject("ingest");
+		ingest["received"] = ingestCounters.received;
+		ingest["dropped"] = ingestCounters.dropped;
+		float frames = reportRate(status.createNestedObject("rate"));
+		reportLink(status.createNestedObject("link"), frames);
 	}
 
+    void onWifiDisconnected() {
+        wifiDisconnects++;
+    }
+
+    void onMqttDisconnected() {
+        mqttDisconnects++;
+    }
+
     void onMqttMessage(const char * topic, JsonObjectConst message) {
-        for (int i = 0; i < sizeof(monitorMetrics)/sizeof(*monitorMetrics); i++) {
-            MonitorMetric & metric = monitorMetrics[i];
-            if (!strcmp(topic, metric.topic)) {
-                char metricName[strlen(metric.name)+1];
-                strcpy(metricName, metric.name);
-                char * token = strtok(metricName, ".");
-                JsonVariantConst tmpVal = message;
-                while (token) {
-                    if (!tmpVal.containsKey(token)) break;
-                    tmpVal = tmpVal[token];
-                    token = strtok(NULL, ".");
-                }
-                if (!token)
-                    metric.value = tmpVal.as<float>() * metric.multiplier;   
-            }
-        }
+        if (!strcmp(topic, MONITOR_PAGE_TOPIC)) updatePage(message);
+        else storeMessagePaths(message, metricPaths, metricsOfTopic(topic));
     }
 };
 
-void beginEPD() {
+void drawMetric(const MonitorMetric & metric, const MetricState & state, EpdFontProperties & props) {
+    // Stale metrics always produce the same pixels, so their slot drops out of the framebuffer diff and stops
+    // being refreshed until fresh data arrives.
+    SlotFrame frame = { state.value, metricStale(state), state.restored, state.alarm };
+    drawSlot(fb, metric.slot, metric.displayName, metric.decimals, metric.sign, frame, props);
+}
+
+// Slots are horizontal bands of the portrait screen, so metrics in different slots never touch the same
+// framebuffer bytes: even metrics are drawn by the loop task, odd ones by the render task on the other core.
+void drawMetrics(int part, EpdFontProperties & props) {
+    for (int i = part; i < metricsCount; i += 2)
+        if (monitorMetrics[i].slot.cursorY >= 0) drawMetric(monitorMetrics[i], metricStates[i], props);
+}
+
+void * layoutAlloc(size_t size, bool internal) {
+    return arenaAlloc(internal ? internalArena : psramArena, size);
+}
+
+void beginBannerLabels() {
+    for (int m = 0; m < metricsCount; m++) {
+        const MonitorMetric & metric = monitorMetrics[m];
+        if (metric.alarmMin != -INFINITY || metric.alarmMax != INFINITY)
+            bannerLabels[m] = buildBannerLabel(metric.displayName, fb, layoutAlloc);
+    }
+}
+
+// Draws the large metric or countdown page, with the names of the alarmed metrics in a banner.
+void drawLargePage() {
+    LayoutImage labels[metricsCount];
+    int alarms = 0;
+    for (int m = 0; m < metricsCount; m++)
+        if (metricStates[m].alarm && bannerLabels[m].data) labels[alarms++] = bannerLabels[m];
+    drawAlarmBanner(fb, labels, alarms);
+    if (page == PAGE_COUNTDOWN) {
+        // Drawn for the moment the frame reaches the panel, MONITOR_COUNTDOWN_LEAD_MS from now.
+        drawCountdown(fb, countdownEndMs - timeMs() - MONITOR_COUNTDOWN_LEAD_MS);
+    } else {
+        const MetricState & state = metricStates[largeMetric];
+        if (metricStale(state) || !isfinite(state.value)) drawLargeDashes(fb);
+        else drawLargeValue(fb, state.value, monitorMetrics[largeMetric].decimals);
+    }
+}
+
+// Delays the next countdown frame so that it is drawn MONITOR_COUNTDOWN_LEAD_MS before a second boundary.
+TickType_t countdownDelay() {
+    int64_t toBoundaryMs = (countdownEndMs - timeMs()) % 1000;
+    if (toBoundaryMs < 0) toBoundaryMs += 1000;
+    toBoundaryMs -= MONITOR_COUNTDOWN_LEAD_MS;
+    if (toBoundaryMs <= 0) toBoundaryMs += 1000;
+    return pdMS_TO_TICKS(toBoundaryMs);
+}
+
+void renderTask(void * pvArguments) {
+    EpdFontProperties props = epd_font_properties_default();
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        drawMetrics(1, props);
+        xSemaphoreGive(renderDone);
+    }
+}
+
+EpdRect boundingArea(EpdRect a, EpdRect b) {
+    int x = min(a.x, b.x);
+    int y = min(a.y, b.y);
+    return { x, y, max(a.x + a.width, b.x + b.width) - x, max(a.y + a.height, b.y + b.height) - y };
+}
+
+// Compares the frame about to be displayed with the one on the panel and returns the changed rectangles, in the
+// rotated coordinates expected by epd_hl_update_area. Dirty rows closer than MONITOR_DIFF_MERGE_ROWS are merged
+// into the same rectangle, spanning the union of their dirty columns. Only the panel columns covered by the words
+// fromWord to toWord (8 pixels each) are compared.
+int computeUpdateAreas(EpdRect * areas, int fromWord, int toWord) {
+    const int stride = EPD_WIDTH / 2;
+    const int len = (toWord - fromWord + 1) * 4;
+    const uint8_t * front = hl.front_fb + fromWord * 4;
+    const uint8_t * back = hl.back_fb + fromWord * 4;
+    int count = 0;
+    if (!fbDiffRows(front, back, EPD_HEIGHT, stride, len, dirtyRows)) return 0;
+    for (int row = 0; row < EPD_HEIGHT; row++) {
+        if (!(dirtyRows[row / 32] >> (row % 32) & 1)) continue;
+        int firstRow = row, lastRow = row;
+        int firstWord = len / 4, lastWord = -1;
+        for (; row < EPD_HEIGHT && row - lastRow <= MONITOR_DIFF_MERGE_ROWS; row++) {
+            int first, last;
+            if (!(dirtyRows[row / 32] >> (row % 32) & 1)) continue;
+            fbDiffRow(front + row * stride, back + row * stride, len, &first, &last);
+            firstWord = min(firstWord, first);
+            lastWord = max(lastWord, last);
+            lastRow = row;
+        }
+        row = lastRow;
+        EpdRect area = { (fromWord + firstWord) * 8, firstRow, (lastWord - firstWord + 1) * 8, lastRow - firstRow + 1 };
+        if (count < MONITOR_DIFF_MAX_AREAS) areas[count++] = area;
+        else areas[count - 1] = boundingArea(areas[count - 1], area);
+    }
+    for (int i = 0; i < count; i++) {
+        EpdRect area = areas[i];
+        areas[i] = { area.y, EPD_WIDTH - area.x - area.width, area.height, area.width };
+    }
+    return count;
+}
+
+// Converts a rectangle in the rotated coordinates of epd_hl_update_area back to panel coordinates.
+EpdRect panelArea(EpdRect area) {
+    return { EPD_WIDTH - area.y - area.height, area.x, area.height, area.width };
+}
+
+// Rounds a rectangle of the highlevel back buffer, in the rotated coordinates of epd_hl_update_area, to what a DU
+// update leaves on the panel. Gray pixels then differ from the front buffer again, so the next GL16 frame drives
+// them back to gray. Update areas always span whole words of panel columns.
+void thresholdBackArea(EpdRect area) {
+    const int stride = EPD_WIDTH / 2;
+    area = panelArea(area);
+    for (int row = area.y; row < area.y + area.height; row++)
+        fbThreshold(hl.back_fb + row * stride + area.x / 2, area.width / 2);
+}
+
+// Updates the bands of the slots using REFRESH_FAST with the DU waveform, which only drives pixels to pure
+// black or white, for the metrics selected in refreshSlots. The highlevel back buffer is updated along and then
+// thresholded like the panel, so the black and white changes drop out of the following diff while the gray pixels
+// of labels, sign edges and restored values are driven back to gray by the next GL16 pass.
+// Returns the index of the slot that is due for a cleanup, if any.
+int refreshFastSlots() {
+    EpdRect areas[MONITOR_DIFF_MAX_AREAS];
+    int cleanup = -1;
+    for (int m = 0; m < metricsCount; m++) {
+        const MonitorSlot & slot = monitorMetrics[m].slot;
+        if (slot.refresh != REFRESH_FAST || slot.cursorY < 0 || !(refreshSlots >> m & 1)) continue;
+        SlotColumns columns = slotColumns(slot);
+        int count = computeUpdateAreas(areas, columns.first / 8, columns.last / 8);
+        for (int i = 0; i < count; i++) {
+            epd_hl_update_area(&hl, MODE_DU, MONITOR_TEMPERATURE_CELSIUS, areas[i]);
+            thresholdBackArea(areas[i]);
+        }
+        if (count) fastUpdates[m]++;
+        // Inverting a slot also drives its grayscale label with DU, so an alarm change calls for a cleanup soon.
+        if (refreshAlarms >> m & 1) fastUpdates[m] = max(fastUpdates[m], MONITOR_CLEANUP_UPDATES);
+        // Prefer cleaning a slot in a frame where its value did not change, unless it has waited too long.
+        if ((fastUpdates[m] >= MONITOR_CLEANUP_UPDATES && !count) || fastUpdates[m] >= MONITOR_CLEANUP_MAX_UPDATES) {
+            if (cleanup < 0 || fastUpdates[m] > fastUpdates[cleanup]) cleanup = m;
+        }
+    }
+    return cleanup;
+}
+
+// Removes the ghosting left by repeated partial updates of a panel area, spanning whole words of columns: it is
+// driven to white with a short clear waveform and then redrawn from white with GL16, leaving the rest of the
+// screen untouched.
+void cleanupArea(EpdRect area) {
+    const int stride = EPD_WIDTH / 2;
+    epd_clear_area_cycles(area, MONITOR_CLEANUP_CYCLES, MONITOR_CLEANUP_CYCLE_TIME);
+    for (int row = area.y; row < area.y + area.height; row++)
+        fbFill(hl.back_fb + row * stride + area.x / 2, area.width / 2, 0xF);
+    epd_hl_update_area(&hl, MODE_EPDIY_WHITE_TO_GL16, MONITOR_TEMPERATURE_CELSIUS, { area.y, EPD_WIDTH - area.x - area.width, area.height, area.width });
+}
+
+// Removes the ghosting left by the DU updates of a slot band.
+void cleanupSlot(int m) {
+    SlotColumns columns = slotColumns(monitorMetrics[m].slot);
+    int fromWord = columns.first / 8;
+    int toWord = columns.last / 8;
+    cleanupArea({ fromWord * 8, 0, (toWord - fromWord + 1) * 8, EPD_HEIGHT });
+    fastUpdates[m] = 0;
+}
+
+// Drives the panel from the highlevel front buffer while the loop task is already drawing the next frame into fb.
+// Besides the fast slots, the rest of the screen (grayscale slots, large pages) gets a cleanup of the union of its
+// updates every MONITOR_CLEANUP_UPDATES frames, and a new page is drawn over a cleared screen.
+void refreshTask(void * pvArguments) {
+    MonitorPage shownPage = page;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (refreshPage != shownPage && !refreshFast) {
+            cleanupArea(epd_full_screen());
+            shownPage = refreshPage;
+            memset(fastUpdates, 0, sizeof(fastUpdates));
+            slowUpdates = 0;
+            xSemaphoreGive(refreshDone);
+            continue;
+        }
+        EpdRect areas[MONITOR_DIFF_MAX_AREAS];
+        int cleanup = refreshFastSlots();
+        int count = computeUpdateAreas(areas, 0, EPD_WIDTH / 8 - 1);
+        for (int i = 0; i < count; i++) {
+            epd_hl_update_area(&hl, refreshFast ? MODE_DU : MODE_GL16, MONITOR_TEMPERATURE_CELSIUS, areas[i]);
+            if (refreshFast) thresholdBackArea(areas[i]);
+            slowArea = slowUpdates || i ? boundingArea(slowArea, areas[i]) : areas[i];
+        }
+        if (count) slowUpdates++;
+        // Cleanups are skipped while an alarm is being shown, the next quiet frame takes care of them.
+        bool slowCleanup = (slowUpdates >= MONITOR_CLEANUP_UPDATES && !count) || slowUpdates >= MONITOR_CLEANUP_MAX_UPDATES;
+        if (!refreshFast && cleanup >= 0) {
+            cleanupSlot(cleanup);
+        } else if (!refreshFast && slowCleanup) {
+            cleanupArea(panelArea(slowArea));
+            slowUpdates = 0;
+        }
+        xSemaphoreGive(refreshDone);
+    }
+}
+
+// After a reset with a restored frame, the panel still shows nearly the same picture: a single short clear cycle
+// replaces the full clear and the logo, and the restored frame follows right away.
+void beginEPD(bool restored) {
     epd_init(EPD_OPTIONS_DEFAULT);
     hl = epd_hl_init(MONITOR_WAVEFORM);
     epd_set_rotation(orientation);
-    fb = epd_hl_get_framebuffer(&hl);
+    fb = (uint8_t *)arenaAlloc(psramArena, MONITOR_FB_SIZE);
     epd_poweron();
-    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED) {
+    // Waking up from deep sleep, the panel shows exactly the last frame, see beginSleepFrame().
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_UNDEFINED) return;
+    if (restored) {
+        epd_clear_area_cycles(epd_full_screen(), MONITOR_CLEANUP_CYCLES, MONITOR_CLEANUP_CYCLE_TIME);
+    } else {
         epd_clear();
-        epd_draw_rotated_image({130, 350, SailtrackLogo_width, SailtrackLogo_height}, SailtrackLogo_data, fb);
+        epd_draw_rotated_image({130, 350, SailtrackLogo_width, SailtrackLogo_height}, SailtrackLogo_data, epd_hl_get_framebuffer(&hl));
         epd_hl_update_screen(&hl, MODE_GL16, MONITOR_TEMPERATURE_CELSIUS);
     }
 }
 
+void beginRenderTask() {
+    renderDone = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(renderTask, "render_task", MONITOR_RENDER_TASK_STACK_SIZE, NULL, MONITOR_RENDER_TASK_PRIORITY, &renderTaskHandle, MONITOR_RENDER_TASK_CORE);
+}
+
+void beginRefreshTask() {
+    refreshDone = xSemaphoreCreateBinary();
+    xSemaphoreGive(refreshDone);
+    xTaskCreatePinnedToCore(refreshTask, "refresh_task", MONITOR_REFRESH_TASK_STACK_SIZE, NULL, MONITOR_REFRESH_TASK_PRIORITY, &refreshTaskHandle, MONITOR_REFRESH_TASK_CORE);
+}
+
+#ifdef MONITOR_SLEEP_INTERVAL_S
+// Connection parameters of the last association, kept across deep sleep to reconnect on timer wake ups without
+// scanning, DHCP or starting SailtrackModule. A zero channel means there is nothing cached.
+struct WifiCache {
+    char ssid[33];
+    char password[65];
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+};
+
+RTC_DATA_ATTR WifiCache wifiCache;
+
+void saveWifiCache() {
+    strlcpy(wifiCache.ssid, WiFi.SSID().c_str(), sizeof(wifiCache.ssid));
+    strlcpy(wifiCache.password, WiFi.psk().c_str(), sizeof(wifiCache.password));
+    memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+    wifiCache.ip = WiFi.localIP();
+    wifiCache.gateway = WiFi.gatewayIP();
+    wifiCache.subnet = WiFi.subnetMask();
+    wifiCache.channel = WiFi.channel();
+}
+
+bool beginCachedWifi() {
+    if (!wifiCache.channel || esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) return false;
+    WiFi.mode(WIFI_STA);
+    WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway), IPAddress(wifiCache.subnet));
+    WiFi.begin(wifiCache.ssid, wifiCache.password, wifiCache.channel, wifiCache.bssid);
+    return true;
+}
+
+// The panel keeps the last frame drawn before deep sleep. It is drawn again from the snapshot into both highlevel
+// buffers, so that the first frame after waking up only updates what changed. Then every metric is marked as
+// restored until fresh data arrives.
+void beginSleepFrame() {
+    for (int i = 0; i < metricsCount; i++) {
+        MetricState & state = metricStates[i];
+        state.restored = snapshot.restored[i];
+        state.updateTime = snapshot.valid[i] && !snapshot.restored[i] ? millis() : 0;
+        state.alarm = snapshot.alarm[i];
+    }
+    fbFill(fb, MONITOR_FB_SIZE, 0xF);
+    if (page == PAGE_METRICS) {
+        drawMetrics(0, fontProps);
+        drawMetrics(1, fontProps);
+    } else {
+        drawLargePage();
+    }
+    memcpy(hl.front_fb, fb, MONITOR_FB_SIZE);
+    memcpy(hl.back_fb, fb, MONITOR_FB_SIZE);
+    for (int i = 0; i < metricsCount; i++) {
+        metricStates[i].restored = snapshot.valid[i];
+        metricStates[i].updateTime = 0;
+        metricStates[i].alarm = false;
+    }
+}
+
+// Returns whether every metric on screen has fresh data, or the network has been up long enough. Until the network
+// is up nothing new can arrive, so the frame is held, up to MONITOR_SLEEP_MAX_AWAKE_MS since boot.
+bool sleepFrameReady() {
+    if (millis() >= MONITOR_SLEEP_MAX_AWAKE_MS) return true;
+    if (!networkStarted) return false;
+    if (millis() - networkStartTime >= MONITOR_SLEEP_AWAKE_MS) return true;
+    for (int i = 0; i < metricsCount; i++) {
+        bool shown = page == PAGE_METRICS ? monitorMetrics[i].slot.cursorY >= 0 : i == largeMetric;
+        if (shown && metricStale(metricStates[i])) return false;
+    }
+    return true;
+}
+
+// Waits for the last frame to reach the panel and sleeps until the next update. If nothing at all was received,
+// the cached connection is dropped so that the next wake up goes through SailtrackModule again.
+void sleepUntilNextUpdate() {
+    bool received = false;
+    for (int i = 0; i < metricsCount; i++) received |= !metricStale(metricStates[i]);
+    if (!received) wifiCache.channel = 0;
+    xSemaphoreTake(refreshDone, portMAX_DELAY);
+    epd_poweroff();
+    uint64_t awakeUs = (uint64_t)millis() * 1000;
+    uint64_t intervalUs = (uint64_t)MONITOR_SLEEP_INTERVAL_S * 1000000;
+    esp_sleep_enable_timer_wakeup(awakeUs < intervalUs ? intervalUs - awakeUs : intervalUs);
+    esp_deep_sleep_start();
+}
+#endif
+
+// Connects to the SailTrack Network while the panel is being initialized.
+void networkTask(void * pvArguments) {
+#ifdef MONITOR_SLEEP_INTERVAL_S
+    if (beginCachedWifi()) {
+        beginIngest();
+        networkStartTime = millis();
+        networkStarted = true;
+        vTaskDelete(NULL);
+    }
+#endif
+    stm.begin(NETWORK_MODULE_NAME, NETWORK_MODULE_IP, (SailtrackModuleCallbacks *)pvArguments);
+    configTime(0, 0, MONITOR_NTP_SERVER);
+    beginIngest();
+#ifdef MONITOR_SLEEP_INTERVAL_S
+    saveWifiCache();
+#endif
+    networkStartTime = millis();
+    networkStarted = true;
+    vTaskDelete(NULL);
+}
+
+void beginNetwork(SailtrackModuleCallbacks * callbacks) {
+    xTaskCreatePinnedToCore(networkTask, "network_task", MONITOR_NETWORK_TASK_STACK_SIZE, callbacks, MONITOR_NETWORK_TASK_PRIORITY, NULL, MONITOR_NETWORK_TASK_CORE);
+}
+
+#ifdef MONITOR_REPLAY_SPEED
+const unsigned long replayBucketsUs[] = { 50, 100, 200, 500, 1000, 2000, 5000 };
+const int replayBucketsCount = sizeof(replayBucketsUs)/sizeof(*replayBucketsUs);
+
+// Feeds recorded SailTrack traffic to the ingest queue in place of the MQTT clients. Each line of the log is a JSON
+// object { "time": <ms>, "topic": <topic>, "message": <payload> }, loaded on the filesystem with uploadfs. Messages
+// are encoded back into the payload format of their topic and queued like received payloads, so the loop task
+// parses them exactly as in the field. Page messages go to updatePage().
+void replayTask(void * pvArguments) {
+    char * line = (char *)arenaAlloc(psramArena, MONITOR_REPLAY_LINE_SIZE);
+    char * payload = (char *)arenaAlloc(psramArena, INGEST_BUFFER_SIZE);
+    PsramJsonDocument doc(MONITOR_REPLAY_LINE_SIZE);
+
+    while (true) {
+        File file = LittleFS.open(MONITOR_REPLAY_FILE);
+        if (!file) {
+            Serial.printf("replay: cannot open %s\n", MONITOR_REPLAY_FILE);
+            vTaskDelete(NULL);
+        }
+#if MONITOR_REPLAY_SPEED
+        // Recorded times are epoch milliseconds, beyond 32 bits.
+        int64_t startTime = millis();
+        int64_t firstTime = -1;
+#endif
+        while (file.available()) {
+            size_t len = file.readBytesUntil('\n', line, MONITOR_REPLAY_LINE_SIZE - 1);
+            if (deserializeJson(doc, line, len)) continue;
+#if MONITOR_REPLAY_SPEED
+            int64_t time = doc["time"].as<double>();
+            if (firstTime < 0) firstTime = time;
+            int64_t waitMs = startTime + (time - firstTime) / MONITOR_REPLAY_SPEED - (int64_t)millis();
+            if (waitMs > 0) vTaskDelay(pdMS_TO_TICKS(waitMs));
+#endif
+            const char * topic = doc["topic"] | "";
+            JsonObjectConst message = doc["message"];
+            if (!strcmp(topic, MONITOR_PAGE_TOPIC)) updatePage(message);
+            for (int i = 0; i < topicsCount; i++) {
+                if (strcmp(topic, monitorTopics[i].topic)) continue;
+                size_t payloadLength = monitorTopics[i].format == JSON ? measureJson(message) : measureMsgPack(message);
+                if (payloadLength >= INGEST_BUFFER_SIZE) continue;
+                if (monitorTopics[i].format == JSON) serializeJson(message, payload, INGEST_BUFFER_SIZE);
+                else serializeMsgPack(message, payload, INGEST_BUFFER_SIZE);
+                queueIngest(i, payload, payloadLength);
+            }
+#if !MONITOR_REPLAY_SPEED
+            taskYIELD();
+#endif
+        }
+        file.close();
+    }
+}
+
+// Prints the values drawn in every frame and, every MONITOR_REPLAY_REPORT_MS, the sustained message rate, the
+// payloads replaced before being parsed and the distribution of the time spent parsing per frame.
+void reportReplayFrame() {
+    static unsigned long buckets[replayBucketsCount + 1];
+    static unsigned long frames, parseTotalUs, parseMaxUs, lastReceived, lastDropped, reportTime;
+    int bucket = 0;
+    while (bucket < replayBucketsCount && ingestParseUs > replayBucketsUs[bucket]) bucket++;
+    buckets[bucket]++;
+    frames++;
+    parseTotalUs += ingestParseUs;
+    parseMaxUs = max(parseMaxUs, ingestParseUs);
+
+    if (millis() - reportTime >= MONITOR_REPLAY_REPORT_MS) {
+        unsigned long received = ingestCounters.received, dropped = ingestCounters.dropped;
+        Serial.printf("replay: %lu msg/s, %lu dropped, parse per frame avg %lu us, max %lu us, histogram",
+            (received - lastReceived) * 1000 / (millis() - reportTime), dropped - lastDropped, parseTotalUs / frames, parseMaxUs);
+        for (int i = 0; i < replayBucketsCount; i++) Serial.printf(" <=%lu:%lu", replayBucketsUs[i], buckets[i]);
+        Serial.printf(" >%lu:%lu\n", replayBucketsUs[replayBucketsCount - 1], buckets[replayBucketsCount]);
+        memset(buckets, 0, sizeof(buckets));
+        frames = parseTotalUs = parseMaxUs = 0;
+        lastReceived = received;
+        lastDropped = dropped;
+        reportTime = millis();
+    }
+
+    Serial.print("frame:");
+    for (int i = 0; i < metricsCount; i++) {
+        const MonitorMetric & metric = monitorMetrics[i];
+        if (metricStale(metricStates[i])) Serial.printf(" %.3s=--", metric.displayName);
+        else Serial.printf(" %.3s=%.*f", metric.displayName, metric.decimals, metricStates[i].value);
+    }
+    Serial.println("");
+}
+
+void beginReplay() {
+    Serial.begin(115200);
+    LittleFS.begin();
+    xTaskCreate(replayTask, "replay_task", MONITOR_REPLAY_TASK_STACK_SIZE, NULL, MONITOR_REPLAY_TASK_PRIORITY, NULL);
+}
+#endif
+
 void setup() {
-    beginEPD();
-    stm.begin("monitor", IPAddress(192, 168, 42, 103), new ModuleCallbacks());
-    for (auto metric : monitorMetrics)
-        stm.subscribe(metric.topic);
+    loopTaskHandle = xTaskGetCurrentTaskHandle();
+    beginResetCounts();
+    beginMemory();
+    beginIngestQueue();
+    beginSinTable();
+    beginDerivedMetrics();
+    bool restored = restoreSnapshot();
+#ifndef MONITOR_REPLAY_SPEED
+    beginNetwork(new ModuleCallbacks());
+#endif
+    beginEPD(restored);
+    // The drawing buffer is not in use yet, glyphs are rasterized into it.
+    beginLayout(fb, layoutAlloc);
+    beginBannerLabels();
+#ifdef MONITOR_SLEEP_INTERVAL_S
+    if (restored && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) beginSleepFrame();
+#endif
+    beginRenderTask();
+    beginRefreshTask();
+#ifdef MONITOR_REPLAY_SPEED
+    beginReplay();
+    networkStarted = true;
+#endif
+    // Without a restored frame the logo stays on screen until the network is up.
+    while (!restored && !networkStarted) delay(LOOP_TASK_INTERVAL_MS);
 }
 
 void loop() { 
     TickType_t lastWakeTime = xTaskGetTickCount();
 
-    epd_hl_set_all_white(&hl);
-    for (int i = 0; i < sizeof(monitorMetrics)/sizeof(*monitorMetrics); i++) {
-        MonitorMetric & metric = monitorMetrics[i];
-        char digits[8];
-        char displayName[8];
-        int cursorX;
-        int cursorY;
-
-        if (metric.type == ANGLE_ZERO_CENTERED) {
-            cursorX = 15;
-            cursorY = metric.slot.cursorY - 153;
-            if (metric.value >= 0) epd_draw_rotated_image({cursorX, cursorY, SignsPlus_width, SignsPlus_height}, SignsPlus_data, fb);
-            else epd_draw_rotated_image({cursorX, cursorY, SignsMinus_width, SignsMinus_height}, SignsMinus_data, fb);
-            metric.value = abs(metric.value);
-        }
-
-        sprintf(digits, metric.type == SPEED ? "%.1f" : "%.0f", metric.value);
-        metric.value = 0;
-        fontProps.flags = EPD_DRAW_ALIGN_RIGHT;
-        cursorX = metric.slot.cursorX;
-        cursorY = metric.slot.cursorY;
-        epd_write_string(&DSEG14Classic_Regular_100, digits, &cursorX, &cursorY, fb, &fontProps);
+    // The countdown keeps its pace through a reconnection, its values catch up on the following frames.
+    if (bootstrapPending() && page != PAGE_COUNTDOWN) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOOP_TASK_INTERVAL_MS));
+        return;
+    }
 
-        sprintf(displayName, "%c\n%c\n%c", metric.displayName[0], metric.displayName[1], metric.displayName[2]);
-        fontProps.flags = EPD_DRAW_ALIGN_CENTER;
-        cursorX = metric.slot.cursorX + 33;
-        cursorY = metric.slot.cursorY - 140;
-        epd_write_string(&Roboto_Bold_40, displayName, &cursorX, &cursorY, fb, &fontProps);
+    drainIngestQueue();
+    aggregateMetrics();
+    evaluateDerivedMetrics();
+    bool alarmRaised = updateAlarms();
+#ifdef MONITOR_SLEEP_INTERVAL_S
+    // The countdown needs a frame every second, so the monitor stays awake while it is shown.
+    if (page != PAGE_COUNTDOWN && !sleepFrameReady()) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOOP_TASK_INTERVAL_MS));
+        return;
     }
-    if (!updateCycles) {
-        epd_clear();
-        epd_hl_set_all_white(&hl);
+#endif
+    saveSnapshot();
+    fbFill(fb, MONITOR_FB_SIZE, 0xF);
+    if (page == PAGE_METRICS) {
+        xTaskNotifyGive(renderTaskHandle);
+        drawMetrics(0, fontProps);
+        xSemaphoreTake(renderDone, portMAX_DELAY);
+    } else {
+        drawLargePage();
     }
-    epd_hl_update_screen(&hl, updateCycles ? MODE_GL16 : MODE_EPDIY_WHITE_TO_GL16, MONITOR_TEMPERATURE_CELSIUS);
-    updateCycles = (updateCycles + 1) % MONITOR_CLEAR_INTERVAL_UPDATES;
+#ifdef MONITOR_REPLAY_SPEED
+    reportReplayFrame();
+#endif
+
+    xSemaphoreTake(refreshDone, portMAX_DELAY);
+    memcpy(epd_hl_get_framebuffer(&hl), fb, MONITOR_FB_SIZE);
+    refreshFast = alarmRaised;
+    // Restored values are drawn in gray, which DU cannot show. Duty-cycled updates are rare enough to always use
+    // GL16, which leaves no ghosting to clean up.
+    uint32_t slots = 0;
+#ifndef MONITOR_SLEEP_INTERVAL_S
+    for (int i = 0; i < metricsCount && page == PAGE_METRICS; i++)
+        if (!metricStates[i].restored) slots |= 1u << i;
+#endif
+    refreshSlots = slots;
+    refreshAlarms = alarmChanges;
+    refreshPage = page;
+    alarmChanges = 0;
+    xTaskNotifyGive(refreshTaskHandle);
+    frameCount++;
+#ifdef MONITOR_SLEEP_INTERVAL_S
+    if (page != PAGE_COUNTDOWN) sleepUntilNextUpdate();
+#endif
 
-    vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(LOOP_TASK_INTERVAL_MS));
+    // A raised alarm ends the wait early, so that it reaches the panel with the next waveform.
+    if (page == PAGE_COUNTDOWN) {
+        ulTaskNotifyTake(pdTRUE, countdownDelay());
+    } else {
+        TickType_t elapsed = xTaskGetTickCount() - lastWakeTime;
+        if (elapsed < pdMS_TO_TICKS(LOOP_TASK_INTERVAL_MS)) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOOP_TASK_INTERVAL_MS) - elapsed);
+    }
 }
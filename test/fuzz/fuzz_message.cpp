@@ -0,0 +1,19 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "message_path.h"
+
+// libFuzzer target over the path of an MQTT message to the screen, built by the fuzz environment (see
+// platformio.ini): the event checks of the ingest client, the JSON stream and the MsgPack decoder into the metrics
+// of the firmware table, the page topic, derived metrics, and the formatting and drawing of every page through
+// lib/MonitorLayout into a host framebuffer. See message_path.h for the input format.
+
+extern "C" int LLVMFuzzerInitialize(int * argc, char *** argv) {
+    beginMessagePath();
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    resetMessagePath();
+    if (ingestMessage(data, size)) drawMessageFrame();
+    return 0;
+}
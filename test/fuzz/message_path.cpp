@@ -0,0 +1,108 @@
+#include "message_path.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Framebuffer.h>
+#include <IngestQueue.h>
+#include <JsonStream.h>
+#include <MetricProgram.h>
+#include <MonitorLayout.h>
+#include <MonitorMessages.h>
+#include <MonitorMetrics.h>
+
+// Derived metrics over the inputs of the default table, with a division that can overflow.
+const char * const derivedExpressions[] = { "sog drift cos *", "roll pitch hypot 0.1 ema", "sog drift / wrap180" };
+const int derivedCount = sizeof(derivedExpressions)/sizeof(*derivedExpressions);
+
+uint8_t * fb;
+StaticJsonDocument<1024> doc;
+float values[metricsCount];
+bool alarms[metricsCount];
+PageSelection selection;
+MetricInstruction programs[derivedCount][16];
+int programLengths[derivedCount];
+
+void * messageAlloc(size_t size, bool internal) {
+    return calloc(1, size);
+}
+
+const char * segment(int metric, int depth) {
+    return monitorMetrics[metric].path.segments[depth];
+}
+
+// The part of storeMetric() in src/main.cpp that does not touch the metric states.
+void store(int metric, float value) {
+    if (!scaleMetric(monitorMetrics[metric], value)) return;
+    values[metric] = value;
+    alarms[metric] |= metricAlarm(monitorMetrics[metric], value);
+}
+
+const JsonStreamPaths paths = { metricsCount, METRIC_PATH_DEPTH, segment, store };
+
+float metricInput(int metric) {
+    return values[metric];
+}
+
+void beginMessagePath() {
+    epd_set_rotation(EPD_ROT_PORTRAIT);
+    fb = (uint8_t *)messageAlloc(MONITOR_FB_SIZE, false);
+    beginLayout(fb, messageAlloc);
+    for (int i = 0; i < derivedCount; i++)
+        if (!compileMetricProgram(derivedExpressions[i], findMetric, programs[i], 16, &programLengths[i])) abort();
+    resetMessagePath();
+}
+
+void resetMessagePath() {
+    for (int i = 0; i < metricsCount; i++) {
+        values[i] = NAN;
+        alarms[i] = false;
+    }
+    selection = { PAGE_METRICS, -1, 0 };
+}
+
+bool ingestMessage(const uint8_t * data, size_t size) {
+    if (!size) return false;
+    bool fragment = data[0] & 1;
+    const char * topic = (const char *)data + 1;
+    const char * end = (const char *)data + size;
+    const char * newline = (const char *)memchr(topic, '\n', end - topic);
+    const char * payload = newline ? newline + 1 : end;
+    int length = end - payload;
+    char name[sizeof(monitorTopics[0].topic)];
+    if (!ingestEventTopic(topic, (newline ? newline : end) - topic, 0, length, length + fragment, name, sizeof(name))) return false;
+    if (!strcmp(name, MONITOR_PAGE_TOPIC)) {
+        PageSelection page;
+        if (deserializeJson(doc, payload, length) || !readPageSelection(doc.as<JsonObjectConst>(), findMetric, 0, page)) return false;
+        selection = page;
+        return true;
+    }
+    if (findTopic(name) < 0) return false;
+    uint32_t candidates = metricsOfTopic(name);
+    jsonStream(payload, length, paths, candidates);
+    if (!deserializeMsgPack(doc, payload, length)) storeMessagePaths(doc.as<JsonVariantConst>(), paths, candidates);
+    return true;
+}
+
+void drawMessageFrame() {
+    fbFill(fb, MONITOR_FB_SIZE, 0xF);
+    EpdFontProperties props = epd_font_properties_default();
+    for (int i = 0; i < metricsCount; i++) {
+        const MonitorMetric & metric = monitorMetrics[i];
+        if (metric.slot.cursorY < 0) continue;
+        SlotFrame frame = { values[i], isnan(values[i]), false, alarms[i] };
+        drawSlot(fb, metric.slot, metric.displayName, metric.decimals, metric.sign, frame, props);
+    }
+    for (int i = 0; i < derivedCount; i++) {
+        SlotFrame frame = { runMetricProgram(programs[i], programLengths[i], metricInput), false, false, false };
+        drawSlot(fb, monitorMetrics[i % metricsCount].slot, "DRV", 1, true, frame, props);
+    }
+    if (selection.page == PAGE_LARGE_METRIC) {
+        float value = values[selection.metric];
+        fbFill(fb, MONITOR_FB_SIZE, 0xF);
+        if (isfinite(value)) drawLargeValue(fb, value, monitorMetrics[selection.metric].decimals);
+        else drawLargeDashes(fb);
+    } else if (selection.page == PAGE_COUNTDOWN) {
+        fbFill(fb, MONITOR_FB_SIZE, 0xF);
+        drawCountdown(fb, selection.countdownEndMs);
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The path of an MQTT message to the screen, through the libraries and the metrics table of the firmware, shared
+// by the fuzz target and the throughput benchmark. A message is the input of the fuzz target: a flags byte, whose
+// bit 0 marks the first fragment of a payload split across several events, the topic up to the first newline,
+// then the payload, e.g. "\0boat\n{\"sog\": 6.5}" or "\0monitor/page\n{\"page\": \"countdown\"}".
+
+void beginMessagePath();
+
+// Checks and decodes a message as the ingest client does, storing its metrics or selecting its page. Payloads of
+// metric topics go through both the JSON stream and the MsgPack decoder, whatever the format of their topic.
+// Returns whether the message was taken.
+bool ingestMessage(const uint8_t * data, size_t size);
+
+// Computes the derived metrics, then draws the metrics page, the large page of the selected metric and the
+// countdown, if any.
+void drawMessageFrame();
+
+// Forgets the values and the page selected by the previous messages.
+void resetMessagePath();
@@ -0,0 +1,75 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "message_path.h"
+
+// Throughput of the message path of the fuzz target over a corpus, built without sanitizers by the throughput
+// environment (see platformio.ini), so that hardening the payload path can be checked not to slow ingest down:
+// `pio run -e throughput -t exec`, or `.pio/build/throughput/program [corpus directory]`. Reports the messages
+// ingested per second, then the time to draw a frame.
+
+#define THROUGHPUT_DEFAULT_CORPUS       "test/fuzz/corpus"
+#define THROUGHPUT_MIN_SECONDS          1.0
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool readCorpus(const char * directory, std::vector<std::string> & messages) {
+    DIR * dir = opendir(directory);
+    if (!dir) return false;
+    while (dirent * entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        std::string path = std::string(directory) + "/" + entry->d_name;
+        FILE * file = fopen(path.c_str(), "rb");
+        if (!file) continue;
+        std::string message;
+        char buffer[4096];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file))) message.append(buffer, read);
+        fclose(file);
+        messages.push_back(message);
+    }
+    closedir(dir);
+    return !messages.empty();
+}
+
+int main(int argc, char ** argv) {
+    const char * directory = argc > 1 ? argv[1] : THROUGHPUT_DEFAULT_CORPUS;
+    std::vector<std::string> messages;
+    if (!readCorpus(directory, messages)) {
+        fprintf(stderr, "no messages in %s\n", directory);
+        return 1;
+    }
+    beginMessagePath();
+    size_t bytes = 0;
+    for (auto & message : messages) bytes += message.size();
+
+    // Rounds over the whole corpus until the minimum time is reached.
+    unsigned long rounds = 0;
+    int taken = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        taken = 0;
+        for (auto & message : messages) taken += ingestMessage((const uint8_t *)message.data(), message.size());
+        rounds++;
+    } while (secondsSince(start) < THROUGHPUT_MIN_SECONDS);
+    double seconds = secondsSince(start);
+    printf("ingest: %zu messages (%d taken), %.0f messages/s, %.1f MB/s\n", messages.size(), taken,
+        rounds * messages.size() / seconds, rounds * bytes / seconds / 1e6);
+
+    unsigned long frames = 0;
+    start = Clock::now();
+    do {
+        drawMessageFrame();
+        frames++;
+    } while (secondsSince(start) < THROUGHPUT_MIN_SECONDS);
+    printf("frame: %.0f us\n", secondsSince(start) * 1e6 / frames);
+    return 0;
+}
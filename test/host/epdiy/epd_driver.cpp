@@ -0,0 +1,184 @@
+#include "epd_driver.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+static enum EpdRotation rotation = EPD_ROT_LANDSCAPE;
+
+void epd_set_rotation(enum EpdRotation r) {
+    rotation = r;
+}
+
+int epd_rotated_display_width() {
+    return rotation == EPD_ROT_PORTRAIT || rotation == EPD_ROT_INVERTED_PORTRAIT ? EPD_HEIGHT : EPD_WIDTH;
+}
+
+int epd_rotated_display_height() {
+    return rotation == EPD_ROT_PORTRAIT || rotation == EPD_ROT_INVERTED_PORTRAIT ? EPD_WIDTH : EPD_HEIGHT;
+}
+
+void epd_draw_pixel(int x, int y, uint8_t color, uint8_t * framebuffer) {
+    int tmp;
+    switch (rotation) {
+        case EPD_ROT_PORTRAIT:
+            tmp = x;
+            x = EPD_WIDTH - y - 1;
+            y = tmp;
+            break;
+        case EPD_ROT_INVERTED_LANDSCAPE:
+            x = EPD_WIDTH - x - 1;
+            y = EPD_HEIGHT - y - 1;
+            break;
+        case EPD_ROT_INVERTED_PORTRAIT:
+            tmp = x;
+            x = y;
+            y = EPD_HEIGHT - tmp - 1;
+            break;
+        default:
+            break;
+    }
+    if (x < 0 || x >= EPD_WIDTH || y < 0 || y >= EPD_HEIGHT) return;
+    uint8_t * byte = &framebuffer[y * EPD_WIDTH / 2 + x / 2];
+    if (x % 2) *byte = (*byte & 0x0F) | (color & 0xF0);
+    else *byte = (*byte & 0xF0) | (color >> 4);
+}
+
+void epd_fill_rect(EpdRect rect, uint8_t color, uint8_t * framebuffer) {
+    for (int y = rect.y; y < rect.y + rect.height; y++)
+        for (int x = rect.x; x < rect.x + rect.width; x++) epd_draw_pixel(x, y, color, framebuffer);
+}
+
+void epd_draw_rotated_image(EpdRect image_area, const uint8_t * image_buffer, uint8_t * framebuffer) {
+    int byteWidth = image_area.width / 2 + image_area.width % 2;
+    for (int y = 0; y < image_area.height; y++) {
+        for (int x = 0; x < image_area.width; x++) {
+            uint8_t byte = image_buffer[y * byteWidth + x / 2];
+            epd_draw_pixel(image_area.x + x, image_area.y + y, x % 2 ? byte & 0xF0 : byte << 4, framebuffer);
+        }
+    }
+}
+
+EpdFontProperties epd_font_properties_default() {
+    EpdFontProperties props = { 0, 15, 0, EPD_DRAW_ALIGN_LEFT };
+    return props;
+}
+
+const EpdGlyph * epd_get_glyph(const EpdFont * font, uint32_t code_point) {
+    for (uint32_t i = 0; i < font->interval_count; i++) {
+        const EpdUnicodeInterval & interval = font->intervals[i];
+        if (code_point >= interval.first && code_point <= interval.last)
+            return &font->glyph[interval.offset + code_point - interval.first];
+        if (code_point < interval.first) return nullptr;
+    }
+    return nullptr;
+}
+
+// Decodes the next UTF-8 code point, 0 at the end of the string.
+static uint32_t nextCodePoint(const char ** string) {
+    const uint8_t * s = (const uint8_t *)*string;
+    if (!*s) return 0;
+    int extra = *s >= 0xF0 ? 3 : *s >= 0xE0 ? 2 : *s >= 0xC0 ? 1 : 0;
+    uint32_t cp = *s++ & (0x7F >> extra);
+    for (int i = 0; i < extra && (*s & 0xC0) == 0x80; i++) cp = cp << 6 | (*s++ & 0x3F);
+    *string = (const char *)s;
+    return cp;
+}
+
+static const EpdGlyph * glyphOrFallback(const EpdFont * font, uint32_t cp, const EpdFontProperties * props) {
+    const EpdGlyph * glyph = epd_get_glyph(font, cp);
+    return glyph ? glyph : epd_get_glyph(font, props->fallback_glyph);
+}
+
+static void drawChar(const EpdFont * font, uint8_t * buffer, int * cursorX, int cursorY, uint32_t cp, const EpdFontProperties * props) {
+    const EpdGlyph * glyph = glyphOrFallback(font, cp, props);
+    if (!glyph) return;
+    int byteWidth = glyph->width / 2 + glyph->width % 2;
+    unsigned long bitmapSize = byteWidth * glyph->height;
+    uint8_t * inflated = nullptr;
+    const uint8_t * bitmap = &font->bitmap[glyph->data_offset];
+    if (font->compressed) {
+        inflated = (uint8_t *)malloc(bitmapSize);
+        uncompress(inflated, &bitmapSize, bitmap, glyph->compressed_size);
+        bitmap = inflated;
+    }
+    uint8_t colorLut[16];
+    for (int c = 0; c < 16; c++) {
+        int color = props->bg_color + c * ((int)props->fg_color - (int)props->bg_color) / 15;
+        colorLut[c] = color < 0 ? 0 : color > 15 ? 15 : color;
+    }
+    bool background = props->flags & EPD_DRAW_BACKGROUND;
+    for (int y = 0; y < glyph->height; y++) {
+        int yy = cursorY - glyph->top + y;
+        for (int x = 0; x < glyph->width; x++) {
+            uint8_t bm = bitmap[y * byteWidth + x / 2];
+            bm = x % 2 ? bm >> 4 : bm & 0x0F;
+            if (background || bm) epd_draw_pixel(*cursorX + glyph->left + x, yy, colorLut[bm] << 4, buffer);
+        }
+    }
+    free(inflated);
+    *cursorX += glyph->advance_x;
+}
+
+// Bounding box of a line of text drawn at (x, y), as computed by epdiy for the alignment.
+static void getTextBounds(const EpdFont * font, const char * string, int x, int y, int * x1, int * y1, int * w, int * h, const EpdFontProperties * props) {
+    int minX = 100000, minY = 100000, maxX = -1, maxY = -1;
+    int originalX = x;
+    uint32_t cp;
+    while ((cp = nextCodePoint(&string))) {
+        const EpdGlyph * glyph = glyphOrFallback(font, cp, props);
+        if (!glyph) continue;
+        int gx1 = x + glyph->left;
+        int gy1 = y + glyph->top - glyph->height;
+        int gx2 = gx1 + glyph->width;
+        int gy2 = gy1 + glyph->height;
+        if (props->flags & EPD_DRAW_BACKGROUND) {
+            minX = std::min(x, std::min(minX, gx1));
+            maxX = std::max(std::max(x + (int)glyph->advance_x, gx2), maxX);
+            minY = std::min(y + font->descender, std::min(minY, gy1));
+            maxY = std::max(y + font->ascender, std::max(maxY, gy2));
+        } else {
+            minX = std::min(minX, gx1);
+            minY = std::min(minY, gy1);
+            maxX = std::max(maxX, gx2);
+            maxY = std::max(maxY, gy2);
+        }
+        x += glyph->advance_x;
+    }
+    *x1 = std::min(originalX, minX);
+    *w = maxX - *x1;
+    *y1 = minY;
+    *h = maxY - minY;
+}
+
+static enum EpdDrawError writeLine(const EpdFont * font, const char * string, int * cursorX, int * cursorY, uint8_t * framebuffer, const EpdFontProperties * props) {
+    if (!*string) return EPD_DRAW_SUCCESS;
+    int x1, y1, w, h;
+    getTextBounds(font, string, *cursorX, *cursorY, &x1, &y1, &w, &h, props);
+    if (w < 0 || h < 0) return EPD_DRAW_NO_DRAWABLE_CHARACTERS;
+    int x = *cursorX;
+    if (props->flags & EPD_DRAW_ALIGN_CENTER) x -= w / 2;
+    else if (props->flags & EPD_DRAW_ALIGN_RIGHT) x -= w;
+    if (props->flags & EPD_DRAW_BACKGROUND)
+        epd_fill_rect({ x, *cursorY - font->ascender, w, font->ascender - font->descender }, props->bg_color << 4, framebuffer);
+    uint32_t cp;
+    while ((cp = nextCodePoint(&string))) drawChar(font, framebuffer, &x, *cursorY, cp, props);
+    *cursorX = x;
+    return EPD_DRAW_SUCCESS;
+}
+
+enum EpdDrawError epd_write_string(const EpdFont * font, const char * string, int * cursor_x, int * cursor_y, uint8_t * framebuffer, const EpdFontProperties * properties) {
+    if (!string) return EPD_DRAW_STRING_INVALID;
+    char * copy = strdup(string);
+    char * rest = copy;
+    int lineStart = *cursor_x;
+    enum EpdDrawError error = EPD_DRAW_SUCCESS;
+    for (char * line = strsep(&rest, "\n"); line; line = strsep(&rest, "\n")) {
+        *cursor_x = lineStart;
+        error = (enum EpdDrawError)(error | writeLine(font, line, cursor_x, cursor_y, framebuffer, properties));
+        *cursor_y += font->advance_y;
+    }
+    free(copy);
+    return error;
+}
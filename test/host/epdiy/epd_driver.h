@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Host stand-in for the drawing part of the epdiy API, used by the native test environment (see lib_extra_dirs in
+// platformio.ini). Only what the monitor draws with is provided, with the behaviour of the epdiy version the
+// firmware is built against: 4bpp framebuffers of EPD_WIDTH x EPD_HEIGHT panel pixels, the first pixel of a byte
+// in its low nibble, and drawing coordinates rotated by epd_set_rotation().
+
+#define EPD_WIDTH 960
+#define EPD_HEIGHT 540
+
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} EpdRect;
+
+typedef struct {
+    uint8_t width;
+    uint8_t height;
+    uint8_t advance_x;
+    int16_t left;
+    int16_t top;
+    uint16_t compressed_size;
+    uint32_t data_offset;
+} EpdGlyph;
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+    uint32_t offset;
+} EpdUnicodeInterval;
+
+typedef struct {
+    const uint8_t * bitmap;
+    const EpdGlyph * glyph;
+    const EpdUnicodeInterval * intervals;
+    uint32_t interval_count;
+    bool compressed;
+    uint16_t advance_y;
+    int ascender;
+    int descender;
+} EpdFont;
+
+enum EpdFontFlags {
+    EPD_DRAW_BACKGROUND = 0x1,
+    EPD_DRAW_ALIGN_LEFT = 0x2,
+    EPD_DRAW_ALIGN_RIGHT = 0x4,
+    EPD_DRAW_ALIGN_CENTER = 0x8
+};
+
+typedef struct {
+    uint8_t fg_color : 4;
+    uint8_t bg_color : 4;
+    uint32_t fallback_glyph;
+    enum EpdFontFlags flags;
+} EpdFontProperties;
+
+enum EpdDrawError {
+    EPD_DRAW_SUCCESS = 0,
+    EPD_DRAW_GLYPH_FALLBACK_FAILED = 0x2,
+    EPD_DRAW_STRING_INVALID = 0x40,
+    EPD_DRAW_NO_DRAWABLE_CHARACTERS = 0x80
+};
+
+enum EpdRotation {
+    EPD_ROT_LANDSCAPE = 0,
+    EPD_ROT_PORTRAIT = 1,
+    EPD_ROT_INVERTED_LANDSCAPE = 2,
+    EPD_ROT_INVERTED_PORTRAIT = 3
+};
+
+void epd_set_rotation(enum EpdRotation rotation);
+int epd_rotated_display_width();
+int epd_rotated_display_height();
+
+// Colors are given in the upper nibble, as in epdiy.
+void epd_draw_pixel(int x, int y, uint8_t color, uint8_t * framebuffer);
+void epd_fill_rect(EpdRect rect, uint8_t color, uint8_t * framebuffer);
+void epd_draw_rotated_image(EpdRect image_area, const uint8_t * image_buffer, uint8_t * framebuffer);
+
+EpdFontProperties epd_font_properties_default();
+const EpdGlyph * epd_get_glyph(const EpdFont * font, uint32_t code_point);
+enum EpdDrawError epd_write_string(const EpdFont * font, const char * string, int * cursor_x, int * cursor_y, uint8_t * framebuffer, const EpdFontProperties * properties);
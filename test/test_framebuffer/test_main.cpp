@@ -0,0 +1,323 @@
+#include <unity.h>
+#include <string.h>
+#include <Framebuffer.h>
+
+// The kernels are checked against nibble-by-nibble references, over every alignment of the buffers within a 16-byte
+// block: the scalar versions everywhere, and on the ESP32-S3 the vector versions as well.
+
+const size_t stride = 480;
+const int rows = 24;
+const uint8_t sentinel = 0xA5;
+
+alignas(16) uint8_t bufferA[stride * rows + 16];
+alignas(16) uint8_t bufferB[stride * rows + 16];
+alignas(16) uint8_t bufferC[stride * rows + 16];
+alignas(16) uint8_t expected[stride * rows + 16];
+uint32_t seed;
+
+uint8_t nextRandom() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+void referenceFill(uint8_t * buf, size_t len, uint8_t color) {
+    for (size_t i = 0; i < len; i++) buf[i] = (color & 0x0F) * 0x11;
+}
+
+uint8_t nibble(const uint8_t * buf, size_t i) {
+    return i % 2 ? buf[i / 2] >> 4 : buf[i / 2] & 0x0F;
+}
+
+void setNibble(uint8_t * buf, size_t i, uint8_t value) {
+    buf[i / 2] = i % 2 ? (buf[i / 2] & 0x0F) | value << 4 : (buf[i / 2] & 0xF0) | value;
+}
+
+void referenceBlitMasked(uint8_t * dst, const uint8_t * src, const uint8_t * mask, size_t len) {
+    for (size_t i = 0; i < len * 2; i++)
+        if (nibble(mask, i)) setNibble(dst, i, nibble(src, i));
+}
+
+void referenceCompose(uint8_t * dst, const uint8_t * src, size_t len, bool max) {
+    for (size_t i = 0; i < len * 2; i++) {
+        uint8_t d = nibble(dst, i), s = nibble(src, i);
+        setNibble(dst, i, max ? (d > s ? d : s) : (d < s ? d : s));
+    }
+}
+
+void referenceThreshold(uint8_t * buf, size_t len) {
+    for (size_t i = 0; i < len * 2; i++) setNibble(buf, i, nibble(buf, i) >= 8 ? 0x0F : 0x00);
+}
+
+bool referenceDiffRow(const uint8_t * a, const uint8_t * b, size_t len, int * firstWord, int * lastWord) {
+    *firstWord = *lastWord = -1;
+    for (size_t i = 0; i < len / 4; i++) {
+        if (!memcmp(a + i * 4, b + i * 4, 4)) continue;
+        if (*firstWord < 0) *firstWord = i;
+        *lastWord = i;
+    }
+    return *firstWord >= 0;
+}
+
+int referenceDiffRows(const uint8_t * a, const uint8_t * b, size_t len, uint32_t * dirtyRows) {
+    int dirty = 0;
+    memset(dirtyRows, 0, (rows + 31) / 32 * 4);
+    for (int row = 0; row < rows; row++) {
+        if (memcmp(a + row * stride, b + row * stride, len)) {
+            dirtyRows[row / 32] |= 1u << (row % 32);
+            dirty++;
+        }
+    }
+    return dirty;
+}
+
+void setUp() {
+    seed = 1;
+}
+
+void tearDown() {}
+
+void randomize(uint8_t * buf, size_t len) {
+    for (size_t i = 0; i < len; i++) buf[i] = nextRandom();
+}
+
+void checkFill(void (*fill)(uint8_t *, size_t, uint8_t)) {
+    for (size_t offset = 0; offset < 16; offset += 4) {
+        for (size_t len = 0; len <= 200; len += 4) {
+            uint8_t color = len / 4 % 16;
+            memset(bufferA, sentinel, sizeof(bufferA));
+            memset(expected, sentinel, sizeof(expected));
+            fill(bufferA + offset, len, color);
+            referenceFill(expected + offset, len, color);
+            TEST_ASSERT_EQUAL_MEMORY(expected, bufferA, sizeof(bufferA));
+        }
+    }
+}
+
+void checkBlitMasked(void (*blit)(uint8_t *, const uint8_t *, const uint8_t *, size_t)) {
+    // The three buffers start at every combination of alignments, misaligned ones included.
+    for (size_t offsetD = 0; offsetD < 16; offsetD += 4) {
+        for (size_t offsetS = 0; offsetS < 16; offsetS += 4) {
+            for (size_t offsetM = 0; offsetM < 16; offsetM += 4) {
+                size_t len = 200 - offsetD;
+                randomize(bufferA, sizeof(bufferA));
+                randomize(bufferB, sizeof(bufferB));
+                // Masks select whole pixels.
+                for (size_t i = 0; i < sizeof(bufferC); i++) {
+                    uint8_t r = nextRandom();
+                    bufferC[i] = (r & 1 ? 0x0F : 0) | (r & 2 ? 0xF0 : 0);
+                }
+                memcpy(expected, bufferA, sizeof(expected));
+                blit(bufferA + offsetD, bufferB + offsetS, bufferC + offsetM, len);
+                referenceBlitMasked(expected + offsetD, bufferB + offsetS, bufferC + offsetM, len);
+                TEST_ASSERT_EQUAL_MEMORY(expected, bufferA, sizeof(bufferA));
+            }
+        }
+    }
+}
+
+void checkCompose(void (*compose)(uint8_t *, const uint8_t *, size_t, bool)) {
+    for (int max = 0; max < 2; max++) {
+        for (size_t offsetD = 0; offsetD < 16; offsetD += 4) {
+            for (size_t offsetS = 0; offsetS < 16; offsetS += 4) {
+                size_t len = 200 - offsetS;
+                randomize(bufferA, sizeof(bufferA));
+                randomize(bufferB, sizeof(bufferB));
+                memcpy(expected, bufferA, sizeof(expected));
+                compose(bufferA + offsetD, bufferB + offsetS, len, max);
+                referenceCompose(expected + offsetD, bufferB + offsetS, len, max);
+                TEST_ASSERT_EQUAL_MEMORY(expected, bufferA, sizeof(bufferA));
+            }
+        }
+    }
+}
+
+void checkThreshold(void (*threshold)(uint8_t *, size_t)) {
+    for (size_t offset = 0; offset < 16; offset += 4) {
+        for (size_t len = 0; len <= 200; len += 4) {
+            randomize(bufferA, sizeof(bufferA));
+            memcpy(expected, bufferA, sizeof(expected));
+            threshold(bufferA + offset, len);
+            referenceThreshold(expected + offset, len);
+            TEST_ASSERT_EQUAL_MEMORY(expected, bufferA, sizeof(bufferA));
+        }
+    }
+}
+
+void checkDiffRow(bool (*diffRow)(const uint8_t *, const uint8_t *, size_t, int *, int *)) {
+    // Differences are placed in the head, the vector part and the tail of the row, and rows without any.
+    for (size_t offsetA = 0; offsetA < 16; offsetA += 4) {
+        for (size_t offsetB = 0; offsetB < 16; offsetB += 4) {
+            for (size_t len = 4; len <= 120; len += 4) {
+                for (int pattern = 0; pattern < 8; pattern++) {
+                    uint8_t * a = bufferA + offsetA;
+                    uint8_t * b = bufferB + offsetB;
+                    randomize(a, len);
+                    memcpy(b, a, len);
+                    if (pattern & 1) b[nextRandom() % len] ^= 0x01;
+                    if (pattern & 2) b[nextRandom() % len] ^= 0x80;
+                    if (pattern & 4) b[len - 1] ^= 0x10;
+                    int first = -2, last = -2, expectedFirst, expectedLast;
+                    bool differs = referenceDiffRow(a, b, len, &expectedFirst, &expectedLast);
+                    TEST_ASSERT_EQUAL(differs, diffRow(a, b, len, &first, &last));
+                    if (!differs) continue;
+                    TEST_ASSERT_EQUAL_INT(expectedFirst, first);
+                    TEST_ASSERT_EQUAL_INT(expectedLast, last);
+                }
+            }
+        }
+    }
+}
+
+void checkDiffRows(int (*diffRows)(const uint8_t *, const uint8_t *, int, size_t, size_t, uint32_t *)) {
+    // Rows of b start at every alignment relative to the rows of a, and the compared length covers both the
+    // full row and slot-sized bands with unaligned heads and tails.
+    const size_t lens[] = { 4, 12, 28, 116, 228, stride - 16 };
+    for (size_t offsetA = 0; offsetA < 16; offsetA += 4) {
+        for (size_t offsetB = 0; offsetB < 16; offsetB += 4) {
+            for (size_t len : lens) {
+                uint8_t * a = bufferA + offsetA;
+                uint8_t * b = bufferB + offsetB;
+                for (size_t i = 0; i < stride * rows; i++) a[i] = b[i] = nextRandom();
+                // Half of the rows get one flipped nibble, at every position along the row.
+                for (int row = 0; row < rows; row += 2) {
+                    size_t byte = row * 37 % len;
+                    b[row * stride + byte] ^= row % 4 ? 0x0F : 0xF0;
+                }
+                // Differences past the compared length must be ignored.
+                b[stride - 1] ^= 0x11;
+                uint32_t dirty[(rows + 31) / 32] = {};
+                uint32_t expectedRows[(rows + 31) / 32];
+                int expectedCount = referenceDiffRows(a, b, len, expectedRows);
+                TEST_ASSERT_EQUAL_INT(expectedCount, diffRows(a, b, rows, stride, len, dirty));
+                TEST_ASSERT_EQUAL_MEMORY(expectedRows, dirty, sizeof(dirty));
+            }
+        }
+    }
+}
+
+void test_fill_scalar() {
+    checkFill(fbFillScalar);
+}
+
+void test_blit_masked_scalar() {
+    checkBlitMasked(fbBlitMaskedScalar);
+}
+
+void test_compose_scalar() {
+    checkCompose(fbComposeScalar);
+}
+
+void test_threshold_scalar() {
+    checkThreshold(fbThresholdScalar);
+}
+
+void test_diff_row_scalar() {
+    checkDiffRow(fbDiffRowScalar);
+}
+
+void test_diff_rows_scalar() {
+    checkDiffRows(fbDiffRowsScalar);
+}
+
+#if CONFIG_IDF_TARGET_ESP32S3
+void test_fill_pie() {
+    checkFill(fbFillPie);
+}
+
+void test_blit_masked_pie() {
+    checkBlitMasked(fbBlitMaskedPie);
+}
+
+void test_compose_pie() {
+    checkCompose(fbComposePie);
+}
+
+void test_threshold_pie() {
+    checkThreshold(fbThresholdPie);
+}
+
+void test_diff_row_pie() {
+    checkDiffRow(fbDiffRowPie);
+}
+
+void test_diff_rows_pie() {
+    checkDiffRows(fbDiffRowsPie);
+}
+#endif
+
+void test_fill_framebuffer() {
+    memset(bufferA, sentinel, sizeof(bufferA));
+    fbFill(bufferA, stride * rows, 0xF);
+    for (size_t i = 0; i < stride * rows; i++) TEST_ASSERT_EQUAL_HEX8(0xFF, bufferA[i]);
+    TEST_ASSERT_EQUAL_HEX8(sentinel, bufferA[stride * rows]);
+}
+
+void test_diff_rows_clears_clean_rows() {
+    uint32_t dirty[(rows + 31) / 32] = { (1u << rows) - 1 };
+    memset(bufferA, 0x77, sizeof(bufferA));
+    memset(bufferB, 0x77, sizeof(bufferB));
+    TEST_ASSERT_EQUAL_INT(0, fbDiffRows(bufferA, bufferB, rows, stride, stride, dirty));
+    TEST_ASSERT_EQUAL_HEX32(0, dirty[0]);
+}
+
+void test_diff_row() {
+    int first, last;
+    memset(bufferA, 0x77, stride);
+    memset(bufferB, 0x77, stride);
+    TEST_ASSERT_FALSE(fbDiffRow(bufferA, bufferB, stride, &first, &last));
+    bufferB[9] = 0x78;
+    bufferB[stride - 2] = 0x87;
+    TEST_ASSERT_TRUE(fbDiffRow(bufferA, bufferB, stride, &first, &last));
+    TEST_ASSERT_EQUAL_INT(2, first);
+    TEST_ASSERT_EQUAL_INT(stride / 4 - 1, last);
+}
+
+void test_threshold() {
+    for (size_t i = 0; i < stride; i++) bufferA[i] = i;
+    memset(bufferA + stride, sentinel, 4);
+    fbThreshold(bufferA, stride);
+    for (size_t i = 0; i < stride; i++) {
+        uint8_t low = (i & 0x0F) >= 8 ? 0x0F : 0x00;
+        uint8_t high = (i & 0xF0) >= 0x80 ? 0xF0 : 0x00;
+        TEST_ASSERT_EQUAL_HEX8(low | high, bufferA[i]);
+    }
+    TEST_ASSERT_EQUAL_HEX8(sentinel, bufferA[stride]);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fill_scalar);
+    RUN_TEST(test_blit_masked_scalar);
+    RUN_TEST(test_compose_scalar);
+    RUN_TEST(test_threshold_scalar);
+    RUN_TEST(test_diff_row_scalar);
+    RUN_TEST(test_diff_rows_scalar);
+#if CONFIG_IDF_TARGET_ESP32S3
+    RUN_TEST(test_fill_pie);
+    RUN_TEST(test_blit_masked_pie);
+    RUN_TEST(test_compose_pie);
+    RUN_TEST(test_threshold_pie);
+    RUN_TEST(test_diff_row_pie);
+    RUN_TEST(test_diff_rows_pie);
+#endif
+    RUN_TEST(test_fill_framebuffer);
+    RUN_TEST(test_diff_rows_clears_clean_rows);
+    RUN_TEST(test_diff_row);
+    RUN_TEST(test_threshold);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+    delay(2000);
+    runUnityTests();
+}
+
+void loop() {}
+#else
+int main() {
+    return runUnityTests();
+}
+#endif
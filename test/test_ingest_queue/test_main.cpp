@@ -0,0 +1,118 @@
+#include <unity.h>
+#include <string.h>
+#include <IngestQueue.h>
+
+char pending[32];
+char parsing[32];
+IngestSlot slot;
+IngestCounters counters;
+
+void push(const char * payload, unsigned long now, bool queued = true) {
+    ingestPush(slot, counters, payload, strlen(payload), queued, now);
+}
+
+void setUp() {
+    slot = { pending, parsing };
+    counters = {};
+}
+
+void tearDown() {}
+
+void test_frame_takes_the_latest_payload() {
+    push("{\"sog\":1}", 100);
+    size_t len = ingestTake(slot);
+    TEST_ASSERT_EQUAL_STRING_LEN("{\"sog\":1}", slot.parsing, len);
+    TEST_ASSERT_EQUAL_UINT(9, len);
+    TEST_ASSERT_EQUAL_UINT(0, ingestTake(slot));
+    TEST_ASSERT_EQUAL_UINT(1, counters.received);
+    TEST_ASSERT_EQUAL_UINT(0, counters.dropped);
+}
+
+// A burst of payloads within one frame coalesces into the newest one, the others being counted as dropped.
+void test_burst_is_dropped_but_the_newest() {
+    const char * const burst[] = { "{\"sog\":1}", "{\"sog\":2}", "{\"sog\":3}", "{\"sog\":4}", "{\"sog\":5}" };
+    for (int i = 0; i < 5; i++) push(burst[i], 100 + i);
+    size_t len = ingestTake(slot);
+    TEST_ASSERT_EQUAL_STRING_LEN("{\"sog\":5}", slot.parsing, len);
+    TEST_ASSERT_EQUAL_UINT(5, counters.received);
+    TEST_ASSERT_EQUAL_UINT(4, counters.dropped);
+    push("{\"sog\":6}", 200);
+    len = ingestTake(slot);
+    TEST_ASSERT_EQUAL_STRING_LEN("{\"sog\":6}", slot.parsing, len);
+    TEST_ASSERT_EQUAL_UINT(4, counters.dropped);
+}
+
+// The taken payload stays intact in the parsing buffer while the next one arrives.
+void test_push_does_not_touch_the_taken_payload() {
+    push("{\"sog\":1}", 100);
+    size_t len = ingestTake(slot);
+    push("{\"sog\":2}", 150);
+    TEST_ASSERT_EQUAL_STRING_LEN("{\"sog\":1}", slot.parsing, len);
+    len = ingestTake(slot);
+    TEST_ASSERT_EQUAL_STRING_LEN("{\"sog\":2}", slot.parsing, len);
+}
+
+// Payloads whose metrics are all parsed on arrival are counted but neither queued nor dropped.
+void test_unqueued_payloads_are_not_dropped() {
+    for (int i = 0; i < 5; i++) push("{\"roll\":1}", 100 + i, false);
+    TEST_ASSERT_EQUAL_UINT(0, ingestTake(slot));
+    TEST_ASSERT_EQUAL_UINT(5, counters.received);
+    TEST_ASSERT_EQUAL_UINT(0, counters.dropped);
+}
+
+void test_interval_and_jitter() {
+    for (int i = 0; i < 100; i++) push("{}", 1000 + 100 * i);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 100, slot.interval);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0, slot.jitter);
+    // Alternating 50 and 150 ms intervals average to 100 ms, deviating from it by 50 ms.
+    unsigned long now = slot.lastArrival;
+    for (int i = 0; i < 200; i++) push("{}", now += i % 2 ? 150 : 50);
+    TEST_ASSERT_FLOAT_WITHIN(5, 100, slot.interval);
+    TEST_ASSERT_FLOAT_WITHIN(10, 50, slot.jitter);
+}
+
+void test_event_topic() {
+    char name[8];
+    TEST_ASSERT_TRUE(ingestEventTopic("boat/x", 4, 0, 10, 10, name, sizeof(name)));
+    TEST_ASSERT_EQUAL_STRING("boat", name);
+    TEST_ASSERT_TRUE(ingestEventTopic("monitor", 7, 0, 0, 0, name, sizeof(name)));
+    TEST_ASSERT_EQUAL_STRING("monitor", name);
+}
+
+// Topics that do not fit, with room for the terminator, and payloads that are split or too large are ignored.
+void test_event_topic_rejects() {
+    char name[8];
+    TEST_ASSERT_FALSE(ingestEventTopic("monitor/page", 8, 0, 10, 10, name, sizeof(name)));
+    TEST_ASSERT_FALSE(ingestEventTopic("boat", -1, 0, 10, 10, name, sizeof(name)));
+    TEST_ASSERT_FALSE(ingestEventTopic("boat", 4, 0, 10, 20, name, sizeof(name)));
+    TEST_ASSERT_FALSE(ingestEventTopic("boat", 4, 10, 10, 20, name, sizeof(name)));
+    TEST_ASSERT_FALSE(ingestEventTopic("boat", 4, 0, INGEST_BUFFER_SIZE + 1, INGEST_BUFFER_SIZE + 1, name, sizeof(name)));
+    TEST_ASSERT_TRUE(ingestEventTopic("boat", 4, 0, INGEST_BUFFER_SIZE, INGEST_BUFFER_SIZE, name, sizeof(name)));
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_takes_the_latest_payload);
+    RUN_TEST(test_burst_is_dropped_but_the_newest);
+    RUN_TEST(test_push_does_not_touch_the_taken_payload);
+    RUN_TEST(test_unqueued_payloads_are_not_dropped);
+    RUN_TEST(test_interval_and_jitter);
+    RUN_TEST(test_event_topic);
+    RUN_TEST(test_event_topic_rejects);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+    delay(2000);
+    runUnityTests();
+}
+
+void loop() {}
+#else
+int main() {
+    return runUnityTests();
+}
+#endif
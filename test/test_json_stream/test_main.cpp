@@ -0,0 +1,142 @@
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <JsonStream.h>
+
+const char * const testPaths[][3] = {
+    { "sog", nullptr },
+    { "imu", "roll", nullptr },
+    { "imu", "pitch", nullptr },
+    { "a\\\"b", nullptr },
+    { "gps", "fix", "lat" }
+};
+
+const int pathsCount = sizeof(testPaths)/sizeof(*testPaths);
+float values[pathsCount];
+int stores;
+
+const char * testSegment(int path, int depth) {
+    return testPaths[path][depth];
+}
+
+void testStore(int path, float value) {
+    values[path] = value;
+    stores++;
+}
+
+const JsonStreamPaths paths = { pathsCount, 3, testSegment, testStore };
+const uint32_t allPaths = (1u << pathsCount) - 1;
+
+bool stream(const char * payload, uint32_t candidates = allPaths) {
+    return jsonStream(payload, strlen(payload), paths, candidates);
+}
+
+void setUp() {
+    for (auto & value : values) value = -1;
+    stores = 0;
+}
+
+void tearDown() {}
+
+void test_top_level_and_nested_paths() {
+    TEST_ASSERT_TRUE(stream("{\"sog\": 6.5, \"imu\": {\"pitch\": -3, \"roll\": 12.25e1}, \"gps\": {\"fix\": {\"lat\": 45.5}}}"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 6.5, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 122.5, values[1]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, -3, values[2]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 45.5, values[4]);
+    TEST_ASSERT_EQUAL_INT(4, stores);
+}
+
+void test_skips_other_values() {
+    TEST_ASSERT_TRUE(stream("{\"name\": \"x}\\\"{\", \"list\": [1, {\"sog\": 2}, [true, null]], \"imu\": {\"yaw\": {\"roll\": 5}}, \"sog\": 1}"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 1, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, -1, values[1]);
+    TEST_ASSERT_EQUAL_INT(1, stores);
+}
+
+void test_only_candidates_are_stored() {
+    TEST_ASSERT_TRUE(stream("{\"sog\": 6.5, \"imu\": {\"roll\": 2, \"pitch\": 3}}", 1u << 2));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, -1, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 3, values[2]);
+    TEST_ASSERT_EQUAL_INT(1, stores);
+}
+
+void test_keys_match_with_escapes() {
+    TEST_ASSERT_TRUE(stream("{\"a\\\"b\": 7}"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 7, values[3]);
+}
+
+void test_non_numbers_are_ignored() {
+    TEST_ASSERT_TRUE(stream("{\"sog\": \"6.5\", \"imu\": {\"roll\": null, \"pitch\": [1]}}"));
+    TEST_ASSERT_EQUAL_INT(0, stores);
+}
+
+void test_numbers_beyond_float_range() {
+    TEST_ASSERT_TRUE(stream("{\"sog\": 1e39, \"imu\": {\"roll\": -1e999999, \"pitch\": 1e-999999}}"));
+    TEST_ASSERT_FLOAT_IS_NAN(values[0]);
+    TEST_ASSERT_FLOAT_IS_NAN(values[1]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0, values[2]);
+}
+
+void test_values_before_an_error_are_kept() {
+    TEST_ASSERT_FALSE(stream("{\"sog\": 4, \"imu\": {\"roll\" 5}}"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 4, values[0]);
+    TEST_ASSERT_EQUAL_INT(1, stores);
+}
+
+void test_truncated_payloads() {
+    const char * payload = "{\"sog\": 4, \"imu\": {\"roll\": 5, \"x\": [\"\\\"\", {}]}}";
+    for (size_t len = 0; len < strlen(payload); len++)
+        TEST_ASSERT_FALSE(jsonStream(payload, len, paths, allPaths));
+    TEST_ASSERT_TRUE(jsonStream(payload, strlen(payload), paths, allPaths));
+}
+
+void test_not_an_object() {
+    TEST_ASSERT_FALSE(stream("[{\"sog\": 4}]"));
+    TEST_ASSERT_FALSE(stream("  "));
+    TEST_ASSERT_FALSE(stream("{\"sog\": 4}", 0));
+    TEST_ASSERT_EQUAL_INT(0, stores);
+}
+
+void test_invalid_bytes_in_skipped_values() {
+    // A NUL byte inside a skipped array used to be taken for a delimiter without being consumed.
+    const char nulInArray[] = "{\"x\":[\0]}";
+    const char nulInObject[] = "{\"x\":{\"a\":\0}}";
+    const char nulAfterValue[] = "{\"x\":[1,\0]}";
+    const char controlInArray[] = "{\"x\":[\x01]}";
+    TEST_ASSERT_FALSE(jsonStream(nulInArray, sizeof(nulInArray) - 1, paths, allPaths));
+    TEST_ASSERT_FALSE(jsonStream(nulInObject, sizeof(nulInObject) - 1, paths, allPaths));
+    TEST_ASSERT_FALSE(jsonStream(nulAfterValue, sizeof(nulAfterValue) - 1, paths, allPaths));
+    TEST_ASSERT_FALSE(jsonStream(controlInArray, sizeof(controlInArray) - 1, paths, allPaths));
+    TEST_ASSERT_EQUAL_INT(0, stores);
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_top_level_and_nested_paths);
+    RUN_TEST(test_skips_other_values);
+    RUN_TEST(test_only_candidates_are_stored);
+    RUN_TEST(test_keys_match_with_escapes);
+    RUN_TEST(test_non_numbers_are_ignored);
+    RUN_TEST(test_numbers_beyond_float_range);
+    RUN_TEST(test_values_before_an_error_are_kept);
+    RUN_TEST(test_truncated_payloads);
+    RUN_TEST(test_not_an_object);
+    RUN_TEST(test_invalid_bytes_in_skipped_values);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+    delay(2000);
+    runUnityTests();
+}
+
+void loop() {}
+#else
+int main() {
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,235 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <Framebuffer.h>
+#include <MonitorLayout.h>
+#include <MonitorMetrics.h>
+
+// Renders known frames of every page of the default metrics table through the layout, as the firmware does, and
+// compares them with the reference images in golden/: portrait PGMs with 16 gray levels. When a reference is missing or
+// differs, the rendering is written next to it as <frame>.actual.pgm and the differing regions are listed. Once
+// the actual images look right, accept them by running the test with MONITOR_GOLDEN_UPDATE=1.
+
+const int width = EPD_HEIGHT;
+const int height = EPD_WIDTH;
+
+struct Region {
+    const char * name;
+    int firstRow;
+    int lastRow;
+};
+
+uint8_t * fb;
+LayoutImage rollLabel;
+
+void * testAlloc(size_t size, bool internal) {
+    return calloc(1, size);
+}
+
+// Draws the metrics shown in a slot, frame holding the content of each metric of the table.
+void drawMetricsPage(const SlotFrame * frame, SlotRefresh refresh) {
+    for (int i = 0; i < metricsCount; i++) {
+        const MonitorMetric & metric = monitorMetrics[i];
+        if (metric.slot.cursorY < 0) continue;
+        MonitorSlot slot = metric.slot;
+        slot.refresh = refresh;
+        EpdFontProperties props = epd_font_properties_default();
+        drawSlot(fb, slot, metric.displayName, metric.decimals, metric.sign, frame[i], props);
+    }
+}
+
+uint8_t pixel(int x, int y) {
+    int panelX = EPD_WIDTH - 1 - y;
+    uint8_t byte = fb[x * EPD_WIDTH / 2 + panelX / 2];
+    return panelX % 2 ? byte >> 4 : byte & 0x0F;
+}
+
+std::string goldenPath(const char * frame, const char * suffix) {
+    std::string path = __FILE__;
+    path.erase(path.find_last_of("/\\") + 1);
+    return path + "golden/" + frame + suffix;
+}
+
+bool writeImage(const std::string & path) {
+    FILE * file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    fprintf(file, "P5\n%d %d\n15\n", width, height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) fputc(pixel(x, y), file);
+    return !fclose(file);
+}
+
+// Returns whether the image could be read, into one byte per pixel.
+bool readImage(const std::string & path, uint8_t * pixels) {
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    int w, h, maxValue;
+    bool ok = fscanf(file, "P5 %d %d %d", &w, &h, &maxValue) == 3 && fgetc(file) != EOF;
+    ok = ok && w == width && h == height && maxValue == 15 && fread(pixels, 1, width * height, file) == (size_t)(width * height);
+    fclose(file);
+    return ok;
+}
+
+void checkFrame(const char * frame, const Region * regions, int regionsCount) {
+    char message[512];
+    if (getenv("MONITOR_GOLDEN_UPDATE")) {
+        TEST_ASSERT_TRUE_MESSAGE(writeImage(goldenPath(frame, ".pgm")), "cannot write the reference");
+        return;
+    }
+    static uint8_t expected[width * height];
+    std::string actualPath = goldenPath(frame, ".actual.pgm");
+    if (!readImage(goldenPath(frame, ".pgm"), expected)) {
+        writeImage(actualPath);
+        snprintf(message, sizeof(message), "missing reference golden/%s.pgm, rendering written to %s", frame, actualPath.c_str());
+        TEST_FAIL_MESSAGE(message);
+    }
+    int length = snprintf(message, sizeof(message), "differs from golden/%s.pgm:", frame);
+    bool differs = false;
+    for (int r = 0; r < regionsCount; r++) {
+        const Region & region = regions[r];
+        int count = 0, firstX = width, lastX = -1, firstY = height, lastY = -1;
+        for (int y = region.firstRow; y <= region.lastRow; y++) {
+            for (int x = 0; x < width; x++) {
+                if (pixel(x, y) == expected[y * width + x]) continue;
+                count++;
+                firstX = fmin(firstX, x);
+                lastX = fmax(lastX, x);
+                firstY = fmin(firstY, y);
+                lastY = fmax(lastY, y);
+            }
+        }
+        if (!count) continue;
+        differs = true;
+        length += snprintf(message + length, sizeof(message) - length, " %s: %d pixels in (%d, %d)-(%d, %d);", region.name, count, firstX, firstY, lastX, lastY);
+        length = fmin(length, sizeof(message) - 1);
+    }
+    if (differs) {
+        writeImage(actualPath);
+        TEST_FAIL_MESSAGE(message);
+    }
+    remove(actualPath.c_str());
+}
+
+// One region per slot band, named after its metric, and one for the rows below the last slot.
+Region metricsRegions[metricsCount + 1];
+int metricsRegionsCount;
+
+void beginMetricsRegions() {
+    int bottom = 0;
+    for (int i = 0; i < metricsCount; i++) {
+        const MonitorMetric & metric = monitorMetrics[i];
+        if (metric.slot.cursorY < 0) continue;
+        metricsRegions[metricsRegionsCount++] = { metric.displayName, metric.slot.cursorY - MONITOR_SLOT_HEIGHT, metric.slot.cursorY - 1 };
+        bottom = fmax(bottom, metric.slot.cursorY);
+    }
+    if (bottom < height) metricsRegions[metricsRegionsCount++] = { "bottom", bottom, height - 1 };
+}
+
+const Region largeRegions[] = { { "top row", 0, 457 }, { "banner", 458, 501 }, { "bottom row", 502, height - 1 } };
+
+void checkMetricsFrame(const char * name, const SlotFrame * frame, SlotRefresh refresh = REFRESH_FAST) {
+    drawMetricsPage(frame, refresh);
+    checkFrame(name, metricsRegions, metricsRegionsCount);
+}
+
+void checkLargeFrame(const char * name) {
+    checkFrame(name, largeRegions, sizeof(largeRegions)/sizeof(*largeRegions));
+}
+
+void setUp() {
+    fbFill(fb, MONITOR_FB_SIZE, 0xF);
+}
+
+void tearDown() {}
+
+void test_metrics() {
+    const SlotFrame frame[metricsCount] = { { 6.4 }, { -3 }, { 12 }, { 8 } };
+    checkMetricsFrame("metrics", frame);
+}
+
+void test_metrics_grayscale() {
+    const SlotFrame frame[metricsCount] = { { 6.4 }, { -3 }, { 12 }, { 8 } };
+    checkMetricsFrame("metrics_grayscale", frame, REFRESH_GRAYSCALE);
+}
+
+void test_metrics_alarm() {
+    const SlotFrame frame[metricsCount] = { { 12.8 }, { 15 }, { -7 }, { -31, false, false, true } };
+    checkMetricsFrame("metrics_alarm", frame);
+}
+
+void test_metrics_stale() {
+    const SlotFrame frame[metricsCount] = { { NAN, true }, { NAN, true }, { NAN, true }, { NAN, true } };
+    checkMetricsFrame("metrics_stale", frame);
+}
+
+void test_metrics_restored() {
+    const SlotFrame frame[metricsCount] = { { 6.4, false, true }, { -3, false, true }, { 12, false, true }, { 8, false, true } };
+    checkMetricsFrame("metrics_restored", frame, REFRESH_GRAYSCALE);
+}
+
+void test_metrics_out_of_range() {
+    const SlotFrame frame[metricsCount] = { { 1234.5 }, { -180 }, { 999.9 }, { -1e9 } };
+    checkMetricsFrame("metrics_out_of_range", frame);
+}
+
+// A derived VMG is a speed, unsigned, and still shows its minus sign when sailing away from the mark.
+void test_metrics_negative_speed() {
+    const SlotFrame frame[metricsCount] = { { -5.3 }, { -3 }, { 12 }, { 8 } };
+    checkMetricsFrame("metrics_negative_speed", frame);
+}
+
+void test_large() {
+    drawLargeValue(fb, 7.5, 1);
+    checkLargeFrame("large");
+}
+
+void test_large_stale() {
+    drawLargeDashes(fb);
+    checkLargeFrame("large_stale");
+}
+
+void test_large_alarm() {
+    drawAlarmBanner(fb, &rollLabel, 1);
+    drawLargeValue(fb, -31, 0);
+    checkLargeFrame("large_alarm");
+}
+
+void test_countdown() {
+    drawCountdown(fb, 298500);
+    checkLargeFrame("countdown");
+}
+
+// A start time in 2100 is accepted, and shown as the longest countdown.
+void test_countdown_far() {
+    drawCountdown(fb, 4102444800000);
+    checkLargeFrame("countdown_far");
+}
+
+int runUnityTests() {
+    epd_set_rotation(EPD_ROT_PORTRAIT);
+    fb = (uint8_t *)testAlloc(MONITOR_FB_SIZE, false);
+    beginLayout(fb, testAlloc);
+    rollLabel = buildBannerLabel("RLL", fb, testAlloc);
+    beginMetricsRegions();
+    UNITY_BEGIN();
+    RUN_TEST(test_metrics);
+    RUN_TEST(test_metrics_grayscale);
+    RUN_TEST(test_metrics_alarm);
+    RUN_TEST(test_metrics_stale);
+    RUN_TEST(test_metrics_restored);
+    RUN_TEST(test_metrics_out_of_range);
+    RUN_TEST(test_metrics_negative_speed);
+    RUN_TEST(test_large);
+    RUN_TEST(test_large_stale);
+    RUN_TEST(test_large_alarm);
+    RUN_TEST(test_countdown);
+    RUN_TEST(test_countdown_far);
+    return UNITY_END();
+}
+
+int main() {
+    return runUnityTests();
+}
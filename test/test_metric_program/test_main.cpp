@@ -0,0 +1,117 @@
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <MetricProgram.h>
+
+const char * const names[] = { "sog", "cog", "wind.twd" };
+float inputs[] = { 6, 30, 90 };
+
+int findName(const char * name) {
+    for (int i = 0; i < 3; i++)
+        if (!strcmp(name, names[i])) return i;
+    return -1;
+}
+
+float input(int metric) {
+    return inputs[metric];
+}
+
+MetricInstruction program[16];
+int length;
+
+bool compile(const char * expression, int capacity = 16) {
+    return compileMetricProgram(expression, findName, program, capacity, &length);
+}
+
+float run() {
+    return runMetricProgram(program, length, input);
+}
+
+void setUp() {
+    length = -1;
+}
+
+void tearDown() {}
+
+void test_constants_and_arithmetic() {
+    TEST_ASSERT_TRUE(compile("1 2 + 4 * 3 / neg"));
+    TEST_ASSERT_EQUAL_INT(8, length);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, -4, run());
+}
+
+void test_metric_inputs() {
+    // VMG from SOG, COG and TWD.
+    TEST_ASSERT_TRUE(compile("sog cog wind.twd - cos *"));
+    TEST_ASSERT_EQUAL_INT(OP_METRIC, program[0].op);
+    TEST_ASSERT_EQUAL_INT(2, program[2].metric);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 3, run());
+}
+
+void test_angles() {
+    TEST_ASSERT_TRUE(compile("1 1 atan2"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 45, run());
+    TEST_ASSERT_TRUE(compile("190 wrap180"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, -170, run());
+    TEST_ASSERT_TRUE(compile("-10 wrap360"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 350, run());
+    TEST_ASSERT_TRUE(compile("3 4 hypot"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 5, run());
+}
+
+void test_ema_keeps_state() {
+    TEST_ASSERT_TRUE(compile("sog 0.5 ema"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 6, run());
+    inputs[0] = 10;
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 8, run());
+    inputs[0] = 6;
+}
+
+// Frames drawn before the first SOG arrives must not pull the average towards 0.
+void test_ema_waits_for_inputs() {
+    TEST_ASSERT_TRUE(compile("sog 0.1 ema"));
+    inputs[0] = NAN;
+    for (int frame = 0; frame < 10; frame++) TEST_ASSERT_TRUE(isnan(run()));
+    inputs[0] = 6;
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 6, run());
+    inputs[0] = NAN;
+    TEST_ASSERT_TRUE(isnan(run()));
+    inputs[0] = 16;
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 7, run());
+    inputs[0] = 6;
+}
+
+void test_invalid_expressions() {
+    TEST_ASSERT_FALSE(compile("+"));
+    TEST_ASSERT_FALSE(compile("1 2"));
+    TEST_ASSERT_FALSE(compile("sog twd -"));
+    TEST_ASSERT_FALSE(compile(""));
+    TEST_ASSERT_FALSE(compile("1 1 1 1 1 1 1 1 1 + + + + + + + +"));
+    TEST_ASSERT_FALSE(compile("1 2 + 3 +", 4));
+    TEST_ASSERT_TRUE(compile("1 2 + 3 +", 5));
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_constants_and_arithmetic);
+    RUN_TEST(test_metric_inputs);
+    RUN_TEST(test_angles);
+    RUN_TEST(test_ema_keeps_state);
+    RUN_TEST(test_ema_waits_for_inputs);
+    RUN_TEST(test_invalid_expressions);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+    delay(2000);
+    runUnityTests();
+}
+
+void loop() {}
+#else
+int main() {
+    return runUnityTests();
+}
+#endif